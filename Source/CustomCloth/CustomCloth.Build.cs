@@ -40,6 +40,7 @@ public class CustomCloth : ModuleRules
 				"SlateCore",
 				"RHI",
 				"RenderCore",
+				"NetCore",
 				"Projects",
 				// ... add private dependencies that you statically link with here ...	
 			}
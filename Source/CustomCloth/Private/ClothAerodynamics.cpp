@@ -0,0 +1,258 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ClothAerodynamics.h"
+
+#include "ClothFrameArena.h"
+#include "ClothMeshComponent.h"
+#include "Async/ParallelFor.h"
+#include "Engine/World.h"
+#include "SceneInterface.h"
+
+// Below this many triangles a pass is cheaper than waking up the task graph.
+static constexpr int32 MinTrianglesPerTask = 1024;
+
+namespace AeroLane
+{
+	enum : int32
+	{
+		EdgeAX, EdgeAY, EdgeAZ,
+		EdgeBX, EdgeBY, EdgeBZ,
+		VelX, VelY, VelZ,
+		ForceX, ForceY, ForceZ,
+		Num
+	};
+}
+
+#pragma region Wind Cache
+
+void FClothWindCache::Update(const UWorld* World, const FTransform& ComponentToWorld, const FBox& LocalBox, const float Time, const float DeltaTime, const float VelocityScale)
+{
+	TimeSinceRefresh += DeltaTime;
+	if (TimeSinceRefresh < RefreshInterval)
+	{
+		return;
+	}
+	TimeSinceRefresh = 0.f;
+
+	// Resolution may change between refreshes, Sample only ever sees the dimension the cells were built with.
+	Dimension = FMath::Max(Resolution, 1);
+	Velocities.SetNumUninitialized(Dimension * Dimension * Dimension);
+
+	if (nullptr == World || nullptr == World->Scene || !LocalBox.IsValid)
+	{
+		for (FVector3f& Velocity : Velocities)
+		{
+			Velocity = FVector3f::ZeroVector;
+		}
+		return;
+	}
+
+	const FVector CellSize = LocalBox.GetSize() / Dimension;
+	BoxMin = FVector3f(LocalBox.Min);
+	InvCellSize = FVector3f(FVector::OneVector / CellSize.ComponentMax(FVector(KINDA_SMALL_NUMBER)));
+
+	for (int32 Z = 0, Idx = 0; Z < Dimension; ++Z)
+	{
+		for (int32 Y = 0; Y < Dimension; ++Y)
+		{
+			for (int32 X = 0; X < Dimension; ++X, ++Idx)
+			{
+				const FVector CellCenter = LocalBox.Min + CellSize * (FVector(X, Y, Z) + 0.5);
+
+				FVector Direction;
+				float Speed, MinGust, MaxGust;
+				World->Scene->GetWindParameters_GameThread(ComponentToWorld.TransformPosition(CellCenter), Direction, Speed, MinGust, MaxGust);
+
+				// Phase shift per cell so gusts roll over the cloth instead of pulsing it as a whole.
+				const float Gust = FMath::Lerp(MinGust, MaxGust, 0.5f + 0.5f * FMath::Sin(Time + Idx * 0.37f));
+				const FVector WorldVelocity = Direction * (Speed + Gust) * VelocityScale;
+				Velocities[Idx] = FVector3f(ComponentToWorld.InverseTransformVectorNoScale(WorldVelocity));
+			}
+		}
+	}
+}
+
+#pragma endregion Wind Cache
+
+#pragma region Aerodynamics
+
+void FClothAerodynamics::Build(const FClothMeshData& Mesh)
+{
+	const auto& [VertexBuffer, IndexBuffer] = Mesh;
+	const int32 NumTris = IndexBuffer.Num() / 3;
+
+	// Greedy coloring, a triangle takes the lowest color none of its particles is already part of.
+	// Particles with a very high valence can run out of the 64 colors a mask holds, their triangles
+	// go into one extra color that is scattered serially.
+	TArray<uint64> UsedColors;
+	UsedColors.SetNumZeroed(VertexBuffer.Num());
+	TArray<uint8> TriangleColors;
+	TriangleColors.SetNumUninitialized(NumTris);
+
+	int32 NumColors = 0;
+	for (int32 T = 0; T < NumTris; ++T)
+	{
+		const uint32 A = IndexBuffer[T * 3], B = IndexBuffer[T * 3 + 1], C = IndexBuffer[T * 3 + 2];
+		const uint64 Taken = UsedColors[A] | UsedColors[B] | UsedColors[C];
+		const int32 Color = Taken != MAX_uint64 ? static_cast<int32>(FMath::CountTrailingZeros64(~Taken)) : SerialColor;
+
+		if (Color != SerialColor)
+		{
+			const uint64 Bit = 1ull << Color;
+			UsedColors[A] |= Bit;
+			UsedColors[B] |= Bit;
+			UsedColors[C] |= Bit;
+		}
+		TriangleColors[T] = static_cast<uint8>(Color);
+		NumColors = FMath::Max(NumColors, Color + 1);
+	}
+
+	// Counting sort by color.
+	ColorOffsets.SetNumZeroed(NumColors + 1);
+	for (const uint8 Color : TriangleColors)
+	{
+		++ColorOffsets[Color + 1];
+	}
+	for (int32 C = 0; C < NumColors; ++C)
+	{
+		ColorOffsets[C + 1] += ColorOffsets[C];
+	}
+
+	Triangles.SetNumUninitialized(NumTris);
+	{
+		TArray<int32> Cursor(ColorOffsets.GetData(), NumColors);
+		for (int32 T = 0; T < NumTris; ++T)
+		{
+			Triangles[Cursor[TriangleColors[T]]++] = T;
+		}
+	}
+
+	NumLanes = Align(NumTris, 4);
+}
+
+void FClothAerodynamics::Apply(FClothMeshData& Mesh, const float DeltaTime, const float AirDensity, FClothFrameArena& Arena)
+{
+	const int32 NumTris = Triangles.Num();
+	if (NumTris == 0 || NumTris * 3 > Mesh.IndexBuffer.Num())
+	{
+		return;
+	}
+
+	Scratch = Arena.Alloc<float>(NumLanes * AeroLane::Num).GetData();
+
+	// Padding lanes must evaluate to zero force.
+	for (int32 Index = AeroLane::EdgeAX; Index < AeroLane::ForceX; ++Index)
+	{
+		FMemory::Memzero(Lane(Index) + NumTris, (NumLanes - NumTris) * sizeof(float));
+	}
+
+	Gather(Mesh);
+	Evaluate(AirDensity);
+	Scatter(Mesh, DeltaTime);
+
+	Scratch = nullptr;
+}
+
+void FClothAerodynamics::Gather(const FClothMeshData& Mesh)
+{
+	const auto& [VertexBuffer, IndexBuffer] = Mesh;
+	const int32 NumTris = Triangles.Num();
+
+	ParallelFor(NumTris, [this, &VertexBuffer, &IndexBuffer](const int32 I)
+	{
+		const uint32 T = Triangles[I];
+		const FClothMeshVertex& A = VertexBuffer[IndexBuffer[T * 3]];
+		const FClothMeshVertex& B = VertexBuffer[IndexBuffer[T * 3 + 1]];
+		const FClothMeshVertex& C = VertexBuffer[IndexBuffer[T * 3 + 2]];
+
+		const FVector3f PosA = A.Position;
+		const FVector3f EdgeA = B.Position - PosA;
+		const FVector3f EdgeB = C.Position - PosA;
+		const FVector3f Centroid = PosA + (EdgeA + EdgeB) / 3.f;
+		const FVector3f Relative = (A.Velocity + B.Velocity + C.Velocity) / 3.f - WindCache.Sample(Centroid);
+
+		Lane(AeroLane::EdgeAX)[I] = EdgeA.X; Lane(AeroLane::EdgeAY)[I] = EdgeA.Y; Lane(AeroLane::EdgeAZ)[I] = EdgeA.Z;
+		Lane(AeroLane::EdgeBX)[I] = EdgeB.X; Lane(AeroLane::EdgeBY)[I] = EdgeB.Y; Lane(AeroLane::EdgeBZ)[I] = EdgeB.Z;
+		Lane(AeroLane::VelX)[I] = Relative.X; Lane(AeroLane::VelY)[I] = Relative.Y; Lane(AeroLane::VelZ)[I] = Relative.Z;
+	}, NumTris < MinTrianglesPerTask ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+}
+
+void FClothAerodynamics::Evaluate(const float AirDensity)
+{
+	// With N = EdgeA x EdgeB (|N| = 2 * Area) and V the velocity relative to the air:
+	//   Drag = -1/2 rho Cd A |V|^2 |cos| V^    = -1/4 rho Cd |N.V| V
+	//   Lift =  1/2 rho Cl A |V|^2 cos sin L^  =  1/4 rho Cl cos (V (N.V) - N (V.V))
+	// which needs one reciprocal square root per triangle and no branches.
+	const VectorRegister4Float DragScale = VectorSetFloat1(-0.25f * AirDensity * Cd);
+	const VectorRegister4Float LiftScale = VectorSetFloat1(0.25f * AirDensity * Cl);
+	const VectorRegister4Float Epsilon = VectorSetFloat1(SMALL_NUMBER);
+
+	const float *EdgeAX = Lane(AeroLane::EdgeAX), *EdgeAY = Lane(AeroLane::EdgeAY), *EdgeAZ = Lane(AeroLane::EdgeAZ);
+	const float *EdgeBX = Lane(AeroLane::EdgeBX), *EdgeBY = Lane(AeroLane::EdgeBY), *EdgeBZ = Lane(AeroLane::EdgeBZ);
+	const float *VelX = Lane(AeroLane::VelX), *VelY = Lane(AeroLane::VelY), *VelZ = Lane(AeroLane::VelZ);
+	float *ForceX = Lane(AeroLane::ForceX), *ForceY = Lane(AeroLane::ForceY), *ForceZ = Lane(AeroLane::ForceZ);
+
+	for (int32 I = 0; I < NumLanes; I += 4)
+	{
+		const VectorRegister4Float AX = VectorLoad(EdgeAX + I), AY = VectorLoad(EdgeAY + I), AZ = VectorLoad(EdgeAZ + I);
+		const VectorRegister4Float BX = VectorLoad(EdgeBX + I), BY = VectorLoad(EdgeBY + I), BZ = VectorLoad(EdgeBZ + I);
+		const VectorRegister4Float VX = VectorLoad(VelX + I), VY = VectorLoad(VelY + I), VZ = VectorLoad(VelZ + I);
+
+		const VectorRegister4Float NX = VectorSubtract(VectorMultiply(AY, BZ), VectorMultiply(AZ, BY));
+		const VectorRegister4Float NY = VectorSubtract(VectorMultiply(AZ, BX), VectorMultiply(AX, BZ));
+		const VectorRegister4Float NZ = VectorSubtract(VectorMultiply(AX, BY), VectorMultiply(AY, BX));
+
+		const VectorRegister4Float NDotV = VectorMultiplyAdd(NX, VX, VectorMultiplyAdd(NY, VY, VectorMultiply(NZ, VZ)));
+		const VectorRegister4Float NDotN = VectorMultiplyAdd(NX, NX, VectorMultiplyAdd(NY, NY, VectorMultiply(NZ, NZ)));
+		const VectorRegister4Float VDotV = VectorMultiplyAdd(VX, VX, VectorMultiplyAdd(VY, VY, VectorMultiply(VZ, VZ)));
+
+		const VectorRegister4Float Cos = VectorMultiply(NDotV, VectorReciprocalSqrtAccurate(VectorMax(VectorMultiply(NDotN, VDotV), Epsilon)));
+		const VectorRegister4Float Drag = VectorMultiply(DragScale, VectorAbs(NDotV));
+		const VectorRegister4Float Lift = VectorMultiply(LiftScale, Cos);
+
+		auto Force = [&](const VectorRegister4Float& V, const VectorRegister4Float& N)
+		{
+			const VectorRegister4Float LiftDir = VectorSubtract(VectorMultiply(V, NDotV), VectorMultiply(N, VDotV));
+			return VectorMultiplyAdd(Drag, V, VectorMultiply(Lift, LiftDir));
+		};
+
+		VectorStore(Force(VX, NX), ForceX + I);
+		VectorStore(Force(VY, NY), ForceY + I);
+		VectorStore(Force(VZ, NZ), ForceZ + I);
+	}
+}
+
+void FClothAerodynamics::Scatter(FClothMeshData& Mesh, const float DeltaTime) const
+{
+	const auto& IndexBuffer = Mesh.IndexBuffer;
+	auto& VertexBuffer = Mesh.VertexBuffer;
+
+	// Each triangle hands a third of its force to every corner.
+	const float Scale = DeltaTime / (3.f * Mass);
+	const float *ForceX = Lane(AeroLane::ForceX), *ForceY = Lane(AeroLane::ForceY), *ForceZ = Lane(AeroLane::ForceZ);
+
+	for (int32 Color = 0; Color + 1 < ColorOffsets.Num(); ++Color)
+	{
+		const int32 First = ColorOffsets[Color];
+		const int32 Num = ColorOffsets[Color + 1] - First;
+
+		ParallelFor(Num, [this, First, Scale, ForceX, ForceY, ForceZ, &VertexBuffer, &IndexBuffer](const int32 Local)
+		{
+			const int32 I = First + Local;
+			const uint32 T = Triangles[I];
+			const FVector3f Impulse { ForceX[I] * Scale, ForceY[I] * Scale, ForceZ[I] * Scale };
+
+			for (int32 Corner = 0; Corner < 3; ++Corner)
+			{
+				FClothMeshVertex& Vertex = VertexBuffer[IndexBuffer[T * 3 + Corner]];
+				if (!Vertex.bDisablePhys)
+				{
+					Vertex.Velocity += Impulse;
+				}
+			}
+		}, Num < MinTrianglesPerTask || Color == SerialColor ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+	}
+}
+
+#pragma endregion Aerodynamics
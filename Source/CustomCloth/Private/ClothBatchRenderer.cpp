@@ -0,0 +1,636 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ClothBatchRenderer.h"
+
+#include "ClothMeshComponent.h"
+#include "DynamicMeshBuilder.h"
+#include "Materials/Material.h"
+
+static constexpr uint32 ClothBatchNumTexCoords = 4;
+
+#pragma region Allocator
+
+int32 FClothBatchAllocator::Allocate(const int32 Num)
+{
+	if (Num <= 0)
+	{
+		return 0;
+	}
+
+	for (int32 R = 0; R < FreeRanges.Num(); ++R)
+	{
+		FRange& Range = FreeRanges[R];
+		if (Range.Num >= Num)
+		{
+			const int32 Offset = Range.Offset;
+			Range.Offset += Num;
+			Range.Num -= Num;
+			if (Range.Num == 0)
+			{
+				FreeRanges.RemoveAt(R, 1, false);
+			}
+			return Offset;
+		}
+	}
+
+	const int32 Offset = HighWater;
+	HighWater += Num;
+	return Offset;
+}
+
+void FClothBatchAllocator::Free(const int32 Offset, const int32 Num)
+{
+	if (Num <= 0)
+	{
+		return;
+	}
+
+	int32 Insert = 0;
+	while (Insert < FreeRanges.Num() && FreeRanges[Insert].Offset < Offset)
+	{
+		++Insert;
+	}
+	FreeRanges.Insert({ Offset, Num }, Insert);
+
+	// Merge with the following range, then with the preceding one.
+	if (Insert + 1 < FreeRanges.Num() && FreeRanges[Insert].Offset + FreeRanges[Insert].Num == FreeRanges[Insert + 1].Offset)
+	{
+		FreeRanges[Insert].Num += FreeRanges[Insert + 1].Num;
+		FreeRanges.RemoveAt(Insert + 1, 1, false);
+	}
+	if (Insert > 0 && FreeRanges[Insert - 1].Offset + FreeRanges[Insert - 1].Num == FreeRanges[Insert].Offset)
+	{
+		FreeRanges[Insert - 1].Num += FreeRanges[Insert].Num;
+		FreeRanges.RemoveAt(Insert, 1, false);
+	}
+
+	// A free tail gives its space back so the draw range shrinks as well.
+	if (FreeRanges.Num() > 0 && FreeRanges.Last().Offset + FreeRanges.Last().Num == HighWater)
+	{
+		HighWater = FreeRanges.Last().Offset;
+		FreeRanges.Pop(false);
+	}
+}
+
+#pragma endregion Allocator
+
+#pragma region Proxies
+
+class FClothBatchSceneProxy final : public FPrimitiveSceneProxy
+{
+public:
+	//~Start FPrimitiveSceneProxy Interface
+	virtual SIZE_T GetTypeHash() const override
+	{
+		static size_t UniquePointer;
+		return reinterpret_cast<size_t>(&UniquePointer);
+	}
+
+	virtual ~FClothBatchSceneProxy() override
+	{
+		VertexBuffers.PositionVertexBuffer.ReleaseResource();
+		VertexBuffers.StaticMeshVertexBuffer.ReleaseResource();
+		VertexBuffers.ColorVertexBuffer.ReleaseResource();
+		IndexBuffer.ReleaseResource();
+		VertexFactory.ReleaseResource();
+	}
+
+	virtual FPrimitiveViewRelevance GetViewRelevance(const FSceneView* View) const override
+	{
+		FPrimitiveViewRelevance Result;
+		Result.bDrawRelevance = IsShown(View);
+		Result.bShadowRelevance = IsShadowCast(View);
+		Result.bDynamicRelevance = true;
+		Result.bRenderInMainPass = ShouldRenderInMainPass();
+		Result.bUsesLightingChannels = GetLightingChannelMask() != GetDefaultLightingChannelMask();
+		Result.bRenderCustomDepth = ShouldRenderCustomDepth();
+		Result.bTranslucentSelfShadow = bCastVolumetricTranslucentShadow;
+		MaterialRelevance.SetPrimitiveViewRelevance(Result);
+		Result.bVelocityRelevance = DrawsVelocity() && Result.bOpaque && Result.bRenderInMainPass;
+		return Result;
+	}
+
+	virtual void GetDynamicMeshElements(const TArray<const FSceneView*>& Views, const FSceneViewFamily& ViewFamily,
+	                                    uint32 VisibilityMap, FMeshElementCollector& Collector) const override
+	{
+		if (NumActiveIndices < 3)
+		{
+			return;
+		}
+
+		const bool bWireframe = AllowDebugViewmodes() && ViewFamily.EngineShowFlags.Wireframe;
+
+		FColoredMaterialRenderProxy* WireframeMaterialInstance = nullptr;
+		if (bWireframe)
+		{
+			WireframeMaterialInstance = new FColoredMaterialRenderProxy(
+				GEngine->WireframeMaterial ? GEngine->WireframeMaterial->GetRenderProxy() : nullptr,
+				FLinearColor(0, 0.5f, 1.f)
+				);
+
+			Collector.RegisterOneFrameMaterialProxy(WireframeMaterialInstance);
+		}
+
+		const FMaterialRenderProxy* MaterialProxy = bWireframe ? WireframeMaterialInstance : MaterialInterface->GetRenderProxy();
+
+		for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+		{
+			if (VisibilityMap & (1 << ViewIndex))
+			{
+				// Every cloth of the batch in one element, freed ranges hold degenerate triangles.
+				FMeshBatch& Mesh = Collector.AllocateMesh();
+				FMeshBatchElement& BatchElement = Mesh.Elements[0];
+				BatchElement.IndexBuffer = &IndexBuffer;
+				Mesh.bWireframe = bWireframe;
+				Mesh.VertexFactory = &VertexFactory;
+				Mesh.MaterialRenderProxy = MaterialProxy;
+
+				bool bHasPrecomputedVolumetricLightmap;
+				FMatrix PreviousLocalToWorld;
+				int32 SingleCaptureIndex;
+				bool bOutputVelocity;
+				GetScene().GetPrimitiveUniformShaderParameters_RenderThread(GetPrimitiveSceneInfo(), bHasPrecomputedVolumetricLightmap, PreviousLocalToWorld, SingleCaptureIndex, bOutputVelocity);
+				bOutputVelocity |= AlwaysHasVelocity();
+
+				FDynamicPrimitiveUniformBuffer& DynamicPrimitiveUniformBuffer = Collector.AllocateOneFrameResource<FDynamicPrimitiveUniformBuffer>();
+				DynamicPrimitiveUniformBuffer.Set(GetLocalToWorld(), PreviousLocalToWorld, GetBounds(), GetLocalBounds(), GetLocalBounds(), true, bHasPrecomputedVolumetricLightmap, bOutputVelocity, GetCustomPrimitiveData());
+				BatchElement.PrimitiveUniformBufferResource = &DynamicPrimitiveUniformBuffer.UniformBuffer;
+
+				BatchElement.FirstIndex = 0;
+				BatchElement.NumPrimitives = NumActiveIndices / 3;
+				BatchElement.MinVertexIndex = 0;
+				BatchElement.MaxVertexIndex = FMath::Max(NumActiveVertices - 1, 0);
+				Mesh.ReverseCulling = IsLocalToWorldDeterminantNegative();
+				Mesh.Type = PT_TriangleList;
+				Mesh.DepthPriorityGroup = SDPG_World;
+				Mesh.bCanApplyViewModeOverrides = false;
+				Collector.AddMesh(ViewIndex, Mesh);
+			}
+		}
+	}
+
+	virtual bool CanBeOccluded() const override
+	{
+		return !MaterialRelevance.bDisableDepthTest;
+	}
+
+	virtual uint32 GetMemoryFootprint() const override
+	{
+		return sizeof(*this) + GetAllocatedSize();
+	}
+
+	uint32 GetAllocatedSize(void) const
+	{
+		return FPrimitiveSceneProxy::GetAllocatedSize();
+	}
+
+	//~End FPrimitiveSceneProxy Interface
+
+	FClothBatchSceneProxy(UClothBatchComponent* InComponent)
+		: FPrimitiveSceneProxy(InComponent)
+		, VertexFactory(InComponent->GetScene()->GetFeatureLevel(), "FClothBatchSceneProxy")
+	{
+		MaterialInterface = InComponent->GetMaterial(0);
+		MaterialRelevance = MaterialInterface->GetRelevance_Concurrent(GetScene().GetFeatureLevel());
+
+		// Start out from the staging copy, it holds the latest state of every member.
+		const int32 NumVertices = InComponent->VertexAllocator.GetHighWater();
+		const int32 NumIndices = InComponent->IndexAllocator.GetHighWater();
+		VertexCapacity = FMath::Max(NumVertices, 1);
+		TArray<FDynamicMeshVertex> Vertices;
+		Vertices.Init(FDynamicMeshVertex(FVector3f::ZeroVector), VertexCapacity);
+		for (int32 Idx = 0; Idx < NumVertices; ++Idx)
+		{
+			Vertices[Idx].Position = InComponent->StagedPositions[Idx];
+			Vertices[Idx].Color = InComponent->StagedColors[Idx];
+		}
+		VertexBuffers.InitFromDynamicVertex(&VertexFactory, Vertices, ClothBatchNumTexCoords);
+
+		TArray<uint32>& Indices = IndexBuffer.Indices;
+		Indices.SetNumZeroed(FMath::Max(NumIndices, 3));
+		FMemory::Memcpy(Indices.GetData(), InComponent->StagedIndices.GetData(), NumIndices * sizeof(uint32));
+		NumActiveVertices = NumVertices;
+		NumActiveIndices = NumIndices;
+
+		BeginInitResource(&VertexBuffers.PositionVertexBuffer);
+		BeginInitResource(&VertexBuffers.StaticMeshVertexBuffer);
+		BeginInitResource(&VertexBuffers.ColorVertexBuffer);
+		BeginInitResource(&IndexBuffer);
+		BeginInitResource(&VertexFactory);
+	}
+
+	/**
+	 * Apply one flush of the batch. Positions, and colors with the topology, cover the vertex span starting at VertexBegin,
+	 * indices the span starting at IndexBegin. Each buffer is locked once.
+	 */
+	void Update_RenderThread(const FClothMeshRenderPayload& Payload, const int32 VertexBegin, const int32 IndexBegin, const int32 NumVertices, const int32 NumIndices)
+	{
+		check(IsInRenderingThread());
+
+		Reserve_RenderThread(NumVertices, NumIndices);
+		NumActiveVertices = NumVertices;
+		NumActiveIndices = NumIndices;
+
+		auto& PositionBuffer = VertexBuffers.PositionVertexBuffer;
+		auto& ColorBuffer = VertexBuffers.ColorVertexBuffer;
+
+		const int32 NumVerts = FMath::Min(Payload.Positions.Num(), VertexCapacity - VertexBegin);
+		if (NumVerts > 0)
+		{
+			FMemory::Memcpy(&PositionBuffer.VertexPosition(VertexBegin), Payload.Positions.GetData(), NumVerts * sizeof(FVector3f));
+			UploadRange_RenderThread(PositionBuffer.VertexBufferRHI, PositionBuffer.GetVertexData(), VertexBegin * PositionBuffer.GetStride(), NumVerts * PositionBuffer.GetStride());
+		}
+
+		if (!Payload.bTopologyDirty)
+		{
+			return;
+		}
+
+		const int32 NumColors = FMath::Min(Payload.Colors.Num(), VertexCapacity - VertexBegin);
+		if (NumColors > 0)
+		{
+			FMemory::Memcpy(&ColorBuffer.VertexColor(VertexBegin), Payload.Colors.GetData(), NumColors * sizeof(FColor));
+			UploadRange_RenderThread(ColorBuffer.VertexBufferRHI, ColorBuffer.GetVertexData(), VertexBegin * ColorBuffer.GetStride(), NumColors * ColorBuffer.GetStride());
+		}
+
+		// Already rebased onto the slots, freed slots hold degenerate triangles.
+		TArray<uint32>& Indices = IndexBuffer.Indices;
+		const int32 NumSpanIndices = FMath::Min(Payload.Indices.Num(), Indices.Num() - IndexBegin);
+		if (NumSpanIndices > 0)
+		{
+			FMemory::Memcpy(Indices.GetData() + IndexBegin, Payload.Indices.GetData(), NumSpanIndices * sizeof(uint32));
+			UploadRange_RenderThread(IndexBuffer.IndexBufferRHI, Indices.GetData(), IndexBegin * sizeof(uint32), NumSpanIndices * sizeof(uint32));
+		}
+	}
+
+private:
+	static void UploadRange_RenderThread(FRHIBuffer* Buffer, const void* Data, const uint32 Offset, const uint32 Size)
+	{
+		if (nullptr == Buffer || Size == 0)
+		{
+			return;
+		}
+		void* BufferData = RHILockBuffer(Buffer, Offset, Size, RLM_WriteOnly);
+		FMemory::Memcpy(BufferData, static_cast<const uint8*>(Data) + Offset, Size);
+		RHIUnlockBuffer(Buffer);
+	}
+
+	/** Grow by at least half, keeping what the other members already uploaded. */
+	void Reserve_RenderThread(const int32 NumVertices, const int32 NumIndices)
+	{
+		auto& PositionBuffer = VertexBuffers.PositionVertexBuffer;
+		auto& StaticMeshBuffer = VertexBuffers.StaticMeshVertexBuffer;
+		auto& ColorBuffer = VertexBuffers.ColorVertexBuffer;
+
+		if (NumVertices > VertexCapacity)
+		{
+			const int32 NewCapacity = FMath::Max(NumVertices, VertexCapacity + VertexCapacity / 2);
+
+			TArray<FVector3f> Positions;
+			Positions.SetNumZeroed(NewCapacity);
+			FMemory::Memcpy(Positions.GetData(), PositionBuffer.GetVertexData(), VertexCapacity * sizeof(FVector3f));
+
+			TArray<FColor> Colors;
+			Colors.Init(FColor::White, NewCapacity);
+			FMemory::Memcpy(Colors.GetData(), ColorBuffer.GetVertexData(), VertexCapacity * sizeof(FColor));
+
+			PositionBuffer.Init(Positions);
+			ColorBuffer.InitFromColorArray(Colors);
+			StaticMeshBuffer.Init(NewCapacity, ClothBatchNumTexCoords);
+			for (int32 Idx = 0; Idx < NewCapacity; ++Idx)
+			{
+				StaticMeshBuffer.SetVertexTangents(Idx, FVector3f(1, 0, 0), FVector3f(0, 1, 0), FVector3f(0, 0, 1));
+				for (uint32 UV = 0; UV < ClothBatchNumTexCoords; ++UV)
+				{
+					StaticMeshBuffer.SetVertexUV(Idx, UV, FVector2f::ZeroVector);
+				}
+			}
+			VertexCapacity = NewCapacity;
+
+			PositionBuffer.UpdateRHI();
+			ColorBuffer.UpdateRHI();
+			StaticMeshBuffer.UpdateRHI();
+
+			FLocalVertexFactory::FDataType Data;
+			PositionBuffer.BindPositionVertexBuffer(&VertexFactory, Data);
+			StaticMeshBuffer.BindTangentVertexBuffer(&VertexFactory, Data);
+			StaticMeshBuffer.BindPackedTexCoordVertexBuffer(&VertexFactory, Data);
+			StaticMeshBuffer.BindLightMapVertexBuffer(&VertexFactory, Data, 0);
+			ColorBuffer.BindColorVertexBuffer(&VertexFactory, Data);
+			VertexFactory.SetData(Data);
+		}
+
+		TArray<uint32>& Indices = IndexBuffer.Indices;
+		if (NumIndices > Indices.Num())
+		{
+			Indices.SetNumZeroed(FMath::Max(NumIndices, Indices.Num() + Indices.Num() / 2));
+			IndexBuffer.UpdateRHI();
+		}
+	}
+
+	FMaterialRelevance MaterialRelevance;
+	UMaterialInterface* MaterialInterface = nullptr;
+
+	FStaticMeshVertexBuffers VertexBuffers;
+	FDynamicMeshIndexBuffer32 IndexBuffer;
+
+	FLocalVertexFactory VertexFactory;
+
+	int32 VertexCapacity = 0;
+	int32 NumActiveVertices = 0;
+	int32 NumActiveIndices = 0;
+};
+
+#pragma endregion Proxies
+
+#pragma region Component
+
+UClothBatchComponent::UClothBatchComponent(const FObjectInitializer& Initializer)
+	: Super(Initializer)
+	, PayloadPool(MakeShared<FClothRenderPayloadPool, ESPMode::ThreadSafe>())
+{
+	PrimaryComponentTick.bCanEverTick = false;
+	SetGenerateOverlapEvents(false);
+	SetCollisionEnabled(ECollisionEnabled::NoCollision);
+}
+
+void UClothBatchComponent::AddCloth(UClothMeshComponent* Cloth)
+{
+	// The slot is allocated with the first update, once the cloth knows its size.
+	Slots.FindOrAdd(Cloth);
+}
+
+void UClothBatchComponent::RemoveCloth(UClothMeshComponent* Cloth)
+{
+	if (FClothBatchSlot* Slot = Slots.Find(Cloth))
+	{
+		FreeSlot(*Slot);
+		Slots.Remove(Cloth);
+	}
+}
+
+void UClothBatchComponent::UpdateCloth(const UClothMeshComponent* Cloth, bool bTopologyChanged)
+{
+	FClothBatchSlot* Slot = Slots.Find(Cloth);
+	if (nullptr == Slot)
+	{
+		return;
+	}
+
+	const TArray<FClothMeshVertex>& VertexBuffer = Cloth->ClothMesh.VertexBuffer;
+	const TArray<uint32>& IndexBuffer = Cloth->ClothMesh.IndexBuffer;
+
+	// The slot covers every particle tearing may add, so tearing does not move the cloth around.
+	if (!Slot->IsValid() || VertexBuffer.Num() > Slot->VertexCapacity || IndexBuffer.Num() != Slot->IndexCount)
+	{
+		FreeSlot(*Slot);
+		Slot->VertexCapacity = Cloth->GetParticleCapacity();
+		Slot->VertexOffset = VertexAllocator.Allocate(Slot->VertexCapacity);
+		Slot->IndexCount = IndexBuffer.Num();
+		Slot->IndexOffset = IndexAllocator.Allocate(Slot->IndexCount);
+		ReserveStaging();
+		bTopologyChanged = true;
+	}
+
+	// Fold the cloth transform into the positions. Relative to this component, which sits in the cell the cloth registered in, so floats stay small.
+	const FTransform3f ClothToBatch(Cloth->GetSimulationToWorld().GetRelativeTransform(GetComponentTransform()));
+	const int32 NumVerts = FMath::Min(VertexBuffer.Num(), Slot->VertexCapacity);
+	FVector3f* Positions = StagedPositions.GetData() + Slot->VertexOffset;
+	for (int32 Idx = 0; Idx < NumVerts; ++Idx)
+	{
+		Positions[Idx] = ClothToBatch.TransformPosition(VertexBuffer[Idx].Position);
+	}
+	MarkVerticesDirty(Slot->VertexOffset, NumVerts);
+
+	if (!bTopologyChanged)
+	{
+		return;
+	}
+
+	FColor* Colors = StagedColors.GetData() + Slot->VertexOffset;
+	for (int32 Idx = 0; Idx < NumVerts; ++Idx)
+	{
+		Colors[Idx] = VertexBuffer[Idx].Color;
+	}
+
+	// Cloth local indices are rebased onto the slot.
+	uint32* Indices = StagedIndices.GetData() + Slot->IndexOffset;
+	for (int32 Idx = 0; Idx < Slot->IndexCount; ++Idx)
+	{
+		Indices[Idx] = IndexBuffer[Idx] + Slot->VertexOffset;
+	}
+	MarkIndicesDirty(Slot->IndexOffset, Slot->IndexCount);
+	bStagedTopologyDirty = true;
+}
+
+void UClothBatchComponent::FreeSlot(FClothBatchSlot& Slot)
+{
+	if (!Slot.IsValid())
+	{
+		return;
+	}
+
+	VertexAllocator.Free(Slot.VertexOffset, Slot.VertexCapacity);
+	IndexAllocator.Free(Slot.IndexOffset, Slot.IndexCount);
+
+	// Turn the triangles into degenerates so the single draw can keep spanning the freed range.
+	FMemory::Memzero(StagedIndices.GetData() + Slot.IndexOffset, Slot.IndexCount * sizeof(uint32));
+	MarkIndicesDirty(Slot.IndexOffset, Slot.IndexCount);
+	bStagedTopologyDirty = true;
+
+	Slot = FClothBatchSlot();
+}
+
+void UClothBatchComponent::ReserveStaging()
+{
+	const int32 NumVertices = VertexAllocator.GetHighWater();
+	if (StagedPositions.Num() < NumVertices)
+	{
+		const int32 OldNum = StagedColors.Num();
+		StagedPositions.SetNumZeroed(NumVertices);
+		StagedColors.SetNumUninitialized(NumVertices);
+		for (int32 Idx = OldNum; Idx < NumVertices; ++Idx)
+		{
+			StagedColors[Idx] = FColor::White;
+		}
+	}
+
+	const int32 NumIndices = IndexAllocator.GetHighWater();
+	if (StagedIndices.Num() < NumIndices)
+	{
+		StagedIndices.SetNumZeroed(NumIndices);
+	}
+}
+
+void UClothBatchComponent::Flush()
+{
+	const int32 NumVertices = VertexAllocator.GetHighWater();
+	const int32 NumIndices = IndexAllocator.GetHighWater();
+	FClothBatchSceneProxy* ClothBatchSceneProxy = static_cast<FClothBatchSceneProxy*>(SceneProxy);
+
+	const bool bVerticesDirty = DirtyVertexBegin < DirtyVertexEnd;
+	const bool bIndicesDirty = DirtyIndexBegin < DirtyIndexEnd;
+	if (nullptr != ClothBatchSceneProxy && (bVerticesDirty || bIndicesDirty || NumVertices != FlushedNumVertices || NumIndices != FlushedNumIndices))
+	{
+		// Spans are clamped to the high water, a freed tail does not need uploading.
+		const int32 VertexBegin = bVerticesDirty ? DirtyVertexBegin : 0;
+		const int32 NumSpanVertices = bVerticesDirty ? FMath::Max(FMath::Min(DirtyVertexEnd, NumVertices) - VertexBegin, 0) : 0;
+		const int32 IndexBegin = bIndicesDirty ? DirtyIndexBegin : 0;
+		const int32 NumSpanIndices = bIndicesDirty ? FMath::Max(FMath::Min(DirtyIndexEnd, NumIndices) - IndexBegin, 0) : 0;
+
+		FClothMeshRenderPayload* Payload = PayloadPool->Acquire();
+		Payload->Positions.SetNumUninitialized(NumSpanVertices, false);
+		FMemory::Memcpy(Payload->Positions.GetData(), StagedPositions.GetData() + VertexBegin, NumSpanVertices * sizeof(FVector3f));
+
+		Payload->bTopologyDirty = bStagedTopologyDirty;
+		if (bStagedTopologyDirty)
+		{
+			Payload->Colors.SetNumUninitialized(NumSpanVertices, false);
+			FMemory::Memcpy(Payload->Colors.GetData(), StagedColors.GetData() + VertexBegin, NumSpanVertices * sizeof(FColor));
+			Payload->Indices.SetNumUninitialized(NumSpanIndices, false);
+			FMemory::Memcpy(Payload->Indices.GetData(), StagedIndices.GetData() + IndexBegin, NumSpanIndices * sizeof(uint32));
+		}
+
+		ENQUEUE_RENDER_COMMAND(FClothBatchUpdate)(
+			[ClothBatchSceneProxy, Payload, VertexBegin, IndexBegin, NumVertices, NumIndices, Pool = PayloadPool] (FRHICommandListImmediate& RHICmdList)
+			{
+				ClothBatchSceneProxy->Update_RenderThread(*Payload, VertexBegin, IndexBegin, NumVertices, NumIndices);
+				Pool->Release(Payload);
+			}
+		);
+		FlushedNumVertices = NumVertices;
+		FlushedNumIndices = NumIndices;
+	}
+
+	DirtyVertexBegin = DirtyIndexBegin = MAX_int32;
+	DirtyVertexEnd = DirtyIndexEnd = 0;
+	bStagedTopologyDirty = false;
+
+	const FTransform WorldToBatch = GetComponentTransform().Inverse();
+
+	FBox NewBounds(ForceInit);
+	for (const auto& [Cloth, Slot] : Slots)
+	{
+		if (const UClothMeshComponent* Member = Cloth.Get())
+		{
+			NewBounds += Member->Bounds.GetBox().TransformBy(WorldToBatch);
+		}
+	}
+
+	if (!(NewBounds == MemberBounds))
+	{
+		MemberBounds = NewBounds;
+
+		// Same path as the cloth component, straight to UpdatePrimitiveTransform without the end of frame dirty pass.
+		if (IsRenderStateCreated())
+		{
+			SendRenderTransform_Concurrent();
+		}
+		else
+		{
+			UpdateBounds();
+		}
+	}
+}
+
+FPrimitiveSceneProxy* UClothBatchComponent::CreateSceneProxy()
+{
+	// The proxy copies the staging buffers, nothing staged so far has to be sent again.
+	DirtyVertexBegin = DirtyIndexBegin = MAX_int32;
+	DirtyVertexEnd = DirtyIndexEnd = 0;
+	bStagedTopologyDirty = false;
+	FlushedNumVertices = VertexAllocator.GetHighWater();
+	FlushedNumIndices = IndexAllocator.GetHighWater();
+	return new FClothBatchSceneProxy(this);
+}
+
+UMaterialInterface* UClothBatchComponent::GetMaterial(int32 ElementIndex) const
+{
+	return nullptr != Material ? Material : UMaterial::GetDefaultMaterial(MD_Surface);
+}
+
+int32 UClothBatchComponent::GetNumMaterials() const
+{
+	return 1;
+}
+
+void UClothBatchComponent::GetUsedMaterials(TArray<UMaterialInterface*>& OutMaterials, bool bGetDebugMaterials) const
+{
+	OutMaterials.Add(GetMaterial(0));
+}
+
+FBoxSphereBounds UClothBatchComponent::CalcBounds(const FTransform& LocalToWorld) const
+{
+	if (!MemberBounds.IsValid)
+	{
+		return FBoxSphereBounds(LocalToWorld.GetLocation(), FVector::ZeroVector, 0.f);
+	}
+	return FBoxSphereBounds(MemberBounds.TransformBy(LocalToWorld));
+}
+
+#pragma endregion Component
+
+#pragma region Subsystem
+
+UClothBatchComponent* UClothBatchSubsystem::AddCloth(UClothMeshComponent* Cloth)
+{
+	FClothBatchKey Key;
+	Key.Material = nullptr != Cloth->ClothMaterial ? Cloth->ClothMaterial : UMaterial::GetDefaultMaterial(MD_Surface);
+	const FVector CellLocation = Cloth->GetComponentLocation() / BatchCellSize;
+	Key.Cell = FIntVector(FMath::FloorToInt(CellLocation.X), FMath::FloorToInt(CellLocation.Y), FMath::FloorToInt(CellLocation.Z));
+
+	UClothBatchComponent*& Batch = Batches.FindOrAdd(Key);
+	if (nullptr == Batch)
+	{
+		// Positions are stored relative to the batch, anchor it at the center of its cell.
+		Batch = NewObject<UClothBatchComponent>(this);
+		Batch->Material = Key.Material;
+		Batch->SetWorldLocation((FVector(Key.Cell) + FVector(0.5)) * BatchCellSize);
+		Batch->RegisterComponentWithWorld(GetWorld());
+		BatchComponents.Add(Batch);
+	}
+
+	Batch->AddCloth(Cloth);
+	return Batch;
+}
+
+void UClothBatchSubsystem::Deinitialize()
+{
+	for (UClothBatchComponent* Batch : BatchComponents)
+	{
+		if (nullptr != Batch)
+		{
+			Batch->DestroyComponent();
+		}
+	}
+	Batches.Empty();
+	BatchComponents.Empty();
+
+	Super::Deinitialize();
+}
+
+void UClothBatchSubsystem::Tick(float DeltaTime)
+{
+	// Cloths tick in the tick groups, tickables after them, so every member has staged its frame by now.
+	// Empty batches flush as well, their last removal still has to clear the draw range.
+	for (UClothBatchComponent* Batch : BatchComponents)
+	{
+		if (nullptr != Batch)
+		{
+			Batch->Flush();
+		}
+	}
+}
+
+bool UClothBatchSubsystem::IsTickableInEditor() const
+{
+	return true;
+}
+
+TStatId UClothBatchSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UClothBatchSubsystem, STATGROUP_Tickables);
+}
+
+#pragma endregion Subsystem
@@ -0,0 +1,432 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ClothMeshBuilder.h"
+
+#include "Engine/StaticMesh.h"
+#include "StaticMeshResources.h"
+
+#pragma region Static Mesh Import
+
+bool FClothMeshBuilder::BuildFromStaticMesh(const UStaticMesh* StaticMesh, const FClothStaticMeshBuildParams& Params, FClothMeshData& OutMesh, TArray<FClothSpringDesc>& OutSprings)
+{
+	OutMesh.Reset();
+	OutSprings.Reset();
+
+	if (nullptr == StaticMesh || nullptr == StaticMesh->GetRenderData())
+	{
+		return false;
+	}
+
+	const FStaticMeshRenderData* RenderData = StaticMesh->GetRenderData();
+	if (!RenderData->LODResources.IsValidIndex(Params.LODIndex))
+	{
+		return false;
+	}
+
+	const FStaticMeshLODResources& LODResource = RenderData->LODResources[Params.LODIndex];
+	if (!LODResource.Sections.IsValidIndex(Params.SectionIndex))
+	{
+		return false;
+	}
+
+	const FStaticMeshSection& Section = LODResource.Sections[Params.SectionIndex];
+	const FPositionVertexBuffer& PositionBuffer = LODResource.VertexBuffers.PositionVertexBuffer;
+	const FStaticMeshVertexBuffer& TangentBuffer = LODResource.VertexBuffers.StaticMeshVertexBuffer;
+	const FColorVertexBuffer& ColorBuffer = LODResource.VertexBuffers.ColorVertexBuffer;
+	const FIndexArrayView SourceIndices = LODResource.IndexBuffer.GetArrayView();
+
+	// CPU copies are stripped in cooked builds unless bAllowCPUAccess is set on the mesh.
+	if (nullptr == PositionBuffer.GetVertexData() || SourceIndices.Num() < static_cast<int32>(Section.FirstIndex + Section.NumTriangles * 3))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("ClothMeshBuilder: %s has no CPU accessible geometry, enable Allow CPU Access."), *StaticMesh->GetName());
+		return false;
+	}
+
+	const bool bHasColors = ColorBuffer.GetNumVertices() == PositionBuffer.GetNumVertices();
+	const bool bHasTangents = TangentBuffer.GetNumVertices() == PositionBuffer.GetNumVertices();
+
+	auto IsPinColor = [&Params](const FColor& Color)
+	{
+		return FMath::Abs(Color.R - Params.PinColor.R) <= Params.PinColorTolerance
+			&& FMath::Abs(Color.G - Params.PinColor.G) <= Params.PinColorTolerance
+			&& FMath::Abs(Color.B - Params.PinColor.B) <= Params.PinColorTolerance;
+	};
+
+	OutMesh.VertexBuffer.Reserve(Section.MaxVertexIndex - Section.MinVertexIndex + 1);
+	for (uint32 V = Section.MinVertexIndex; V <= Section.MaxVertexIndex; ++V)
+	{
+		const FColor Color = bHasColors ? ColorBuffer.VertexColor(V) : FColor::White;
+		const FVector3f Normal = bHasTangents ? FVector3f(TangentBuffer.VertexTangentZ(V)) : FVector3f::UpVector;
+
+		FClothMeshVertex& Vertex = OutMesh.VertexBuffer.Add_GetRef(FClothMeshVertex{ PositionBuffer.VertexPosition(V), Color, Normal });
+		Vertex.bDisablePhys = bHasColors && IsPinColor(Color);
+	}
+
+	OutMesh.IndexBuffer.Reserve(Section.NumTriangles * 3);
+	for (uint32 I = 0; I < Section.NumTriangles * 3; ++I)
+	{
+		OutMesh.IndexBuffer.Add(SourceIndices[Section.FirstIndex + I] - Section.MinVertexIndex);
+	}
+
+	WeldVertices(OutMesh, Params.WeldThreshold);
+	ReorderParticlesMorton(OutMesh);
+	OptimizeIndexBufferForVertexCache(OutMesh.IndexBuffer, OutMesh.VertexBuffer.Num());
+	BuildSprings(OutMesh, OutSprings);
+
+	return OutMesh.IndexBuffer.Num() > 0;
+}
+
+#pragma endregion Static Mesh Import
+
+#pragma region Topology
+
+void FClothMeshBuilder::WeldVertices(FClothMeshData& Mesh, const float Threshold)
+{
+	const int32 NumVerts = Mesh.VertexBuffer.Num();
+	const float CellSize = FMath::Max(Threshold, KINDA_SMALL_NUMBER);
+	const float ThresholdSq = FMath::Square(Threshold);
+
+	auto CellOf = [CellSize](const FVector3f& Position)
+	{
+		return FIntVector(
+			FMath::FloorToInt(Position.X / CellSize),
+			FMath::FloorToInt(Position.Y / CellSize),
+			FMath::FloorToInt(Position.Z / CellSize));
+	};
+
+	TArray<FClothMeshVertex> Welded;
+	Welded.Reserve(NumVerts);
+	TMultiMap<FIntVector, int32> Grid;
+	Grid.Reserve(NumVerts);
+
+	// A vertex within Threshold can only live in the 27 cells around our own.
+	auto FindWeldTarget = [&](const FVector3f& Position, const FIntVector& Cell)
+	{
+		for (int32 DX = -1; DX <= 1; ++DX)
+		for (int32 DY = -1; DY <= 1; ++DY)
+		for (int32 DZ = -1; DZ <= 1; ++DZ)
+		{
+			for (auto It = Grid.CreateConstKeyIterator(Cell + FIntVector(DX, DY, DZ)); It; ++It)
+			{
+				if (FVector3f::DistSquared(Welded[It.Value()].Position, Position) <= ThresholdSq)
+				{
+					return It.Value();
+				}
+			}
+		}
+		return static_cast<int32>(INDEX_NONE);
+	};
+
+	TArray<uint32> Remap;
+	Remap.SetNumUninitialized(NumVerts);
+	for (int32 V = 0; V < NumVerts; ++V)
+	{
+		const FClothMeshVertex& Vertex = Mesh.VertexBuffer[V];
+		const FIntVector Cell = CellOf(Vertex.Position);
+
+		int32 Target = FindWeldTarget(Vertex.Position, Cell);
+		if (INDEX_NONE == Target)
+		{
+			Target = Welded.Add(Vertex);
+			Grid.Add(Cell, Target);
+		}
+		else
+		{
+			FClothMeshVertex& WeldedVertex = Welded[Target];
+			WeldedVertex.bDisablePhys |= Vertex.bDisablePhys;
+			WeldedVertex.Normal += Vertex.Normal;
+		}
+		Remap[V] = static_cast<uint32>(Target);
+	}
+
+	for (FClothMeshVertex& Vertex : Welded)
+	{
+		Vertex.Normal = Vertex.Normal.GetSafeNormal(SMALL_NUMBER, FVector3f::UpVector);
+	}
+
+	TArray<uint32> Indices;
+	Indices.Reserve(Mesh.IndexBuffer.Num());
+	for (int32 I = 0; I + 2 < Mesh.IndexBuffer.Num(); I += 3)
+	{
+		const uint32 A = Remap[Mesh.IndexBuffer[I]];
+		const uint32 B = Remap[Mesh.IndexBuffer[I + 1]];
+		const uint32 C = Remap[Mesh.IndexBuffer[I + 2]];
+		if (A == B || B == C || A == C)
+		{
+			continue;
+		}
+		Indices.Append({ A, B, C });
+	}
+
+	Mesh.VertexBuffer = MoveTemp(Welded);
+	Mesh.IndexBuffer = MoveTemp(Indices);
+}
+
+static uint64 MakeEdgeKey(const uint32 A, const uint32 B)
+{
+	return A < B ? (static_cast<uint64>(A) << 32) | B : (static_cast<uint64>(B) << 32) | A;
+}
+
+void FClothMeshBuilder::BuildSprings(const FClothMeshData& Mesh, TArray<FClothSpringDesc>& OutSprings)
+{
+	struct FEdgeInfo
+	{
+		uint32 Opposite[2] = { 0, 0 };
+		int32 NumFaces = 0;
+		int32 NumFacesLongest = 0;
+	};
+
+	const auto& [VertexBuffer, IndexBuffer] = Mesh;
+
+	// TMap iterates in insertion order as long as nothing is removed, which keeps spring order stable across runs.
+	TMap<uint64, FEdgeInfo> Edges;
+	Edges.Reserve(IndexBuffer.Num());
+	for (int32 I = 0; I + 2 < IndexBuffer.Num(); I += 3)
+	{
+		const uint32 Tri[3] = { IndexBuffer[I], IndexBuffer[I + 1], IndexBuffer[I + 2] };
+
+		int32 Longest = 0;
+		float LongestSq = -1.f;
+		for (int32 E = 0; E < 3; ++E)
+		{
+			const float LengthSq = FVector3f::DistSquared(VertexBuffer[Tri[E]].Position, VertexBuffer[Tri[(E + 1) % 3]].Position);
+			if (LengthSq > LongestSq)
+			{
+				LongestSq = LengthSq;
+				Longest = E;
+			}
+		}
+
+		for (int32 E = 0; E < 3; ++E)
+		{
+			FEdgeInfo& Edge = Edges.FindOrAdd(MakeEdgeKey(Tri[E], Tri[(E + 1) % 3]));
+			if (Edge.NumFaces < 2)
+			{
+				Edge.Opposite[Edge.NumFaces] = Tri[(E + 2) % 3];
+			}
+			++Edge.NumFaces;
+			Edge.NumFacesLongest += E == Longest ? 1 : 0;
+		}
+	}
+
+	auto AddSpring = [&VertexBuffer, &OutSprings](const uint32 A, const uint32 B, const ESpringType Type)
+	{
+		const float RestLength = FVector3f::Distance(VertexBuffer[A].Position, VertexBuffer[B].Position);
+		OutSprings.Add({ static_cast<int32>(A), static_cast<int32>(B), RestLength, Type });
+	};
+
+	TSet<uint64> CrossPairs;
+	OutSprings.Reserve(Edges.Num() * 2);
+	for (const auto& [Key, Edge] : Edges)
+	{
+		const uint32 A = static_cast<uint32>(Key >> 32);
+		const uint32 B = static_cast<uint32>(Key & 0xFFFFFFFF);
+
+		// An interior edge that is the hypotenuse of both triangles is the diagonal of a quad.
+		const bool bQuadDiagonal = Edge.NumFaces == 2 && Edge.NumFacesLongest == 2;
+		AddSpring(A, B, bQuadDiagonal ? ESpringType::Shear : ESpringType::Structural);
+
+		if (Edge.NumFaces != 2)
+		{
+			continue;
+		}
+
+		const uint64 CrossKey = MakeEdgeKey(Edge.Opposite[0], Edge.Opposite[1]);
+		if (Edges.Contains(CrossKey) || CrossPairs.Contains(CrossKey))
+		{
+			continue;
+		}
+		CrossPairs.Add(CrossKey);
+		AddSpring(Edge.Opposite[0], Edge.Opposite[1], bQuadDiagonal ? ESpringType::Shear : ESpringType::Bending);
+	}
+}
+
+#pragma endregion Topology
+
+#pragma region Reordering
+
+// Spread the low 10 bits of V so that there are two zero bits between each.
+static uint32 ExpandBits10(uint32 V)
+{
+	V &= 0x000003FF;
+	V = (V | (V << 16)) & 0x030000FF;
+	V = (V | (V << 8)) & 0x0300F00F;
+	V = (V | (V << 4)) & 0x030C30C3;
+	V = (V | (V << 2)) & 0x09249249;
+	return V;
+}
+
+void FClothMeshBuilder::ReorderParticlesMorton(FClothMeshData& Mesh)
+{
+	const int32 NumVerts = Mesh.VertexBuffer.Num();
+	if (NumVerts == 0)
+	{
+		return;
+	}
+
+	FBox3f Box(ForceInit);
+	for (const FClothMeshVertex& Vertex : Mesh.VertexBuffer)
+	{
+		Box += Vertex.Position;
+	}
+	const FVector3f Extent = Box.GetSize().ComponentMax(FVector3f(SMALL_NUMBER));
+
+	TArray<TPair<uint32, int32>> Keys;
+	Keys.SetNumUninitialized(NumVerts);
+	for (int32 V = 0; V < NumVerts; ++V)
+	{
+		const FVector3f Normalized = (Mesh.VertexBuffer[V].Position - Box.Min) / Extent * 1023.f;
+		const uint32 X = ExpandBits10(static_cast<uint32>(Normalized.X));
+		const uint32 Y = ExpandBits10(static_cast<uint32>(Normalized.Y));
+		const uint32 Z = ExpandBits10(static_cast<uint32>(Normalized.Z));
+		Keys[V] = { (X << 2) | (Y << 1) | Z, V };
+	}
+
+	// Tie-break on the old index so the result does not depend on sort stability.
+	Keys.Sort([](const TPair<uint32, int32>& L, const TPair<uint32, int32>& R)
+	{
+		return L.Key != R.Key ? L.Key < R.Key : L.Value < R.Value;
+	});
+
+	TArray<FClothMeshVertex> Reordered;
+	Reordered.SetNumUninitialized(NumVerts);
+	TArray<uint32> OldToNew;
+	OldToNew.SetNumUninitialized(NumVerts);
+	for (int32 NewIdx = 0; NewIdx < NumVerts; ++NewIdx)
+	{
+		Reordered[NewIdx] = Mesh.VertexBuffer[Keys[NewIdx].Value];
+		OldToNew[Keys[NewIdx].Value] = NewIdx;
+	}
+
+	for (uint32& Index : Mesh.IndexBuffer)
+	{
+		Index = OldToNew[Index];
+	}
+	Mesh.VertexBuffer = MoveTemp(Reordered);
+}
+
+void FClothMeshBuilder::OptimizeIndexBufferForVertexCache(TArray<uint32>& Indices, const int32 NumVertices, const int32 CacheSize)
+{
+	const int32 NumTris = Indices.Num() / 3;
+	if (NumTris == 0 || NumVertices == 0)
+	{
+		return;
+	}
+
+	// Vertex -> triangle adjacency in CSR form.
+	TArray<int32> LiveTriangles;
+	LiveTriangles.SetNumZeroed(NumVertices);
+	for (int32 I = 0; I < NumTris * 3; ++I)
+	{
+		++LiveTriangles[Indices[I]];
+	}
+
+	TArray<int32> AdjOffsets;
+	AdjOffsets.SetNumUninitialized(NumVertices + 1);
+	AdjOffsets[0] = 0;
+	for (int32 V = 0; V < NumVertices; ++V)
+	{
+		AdjOffsets[V + 1] = AdjOffsets[V] + LiveTriangles[V];
+	}
+
+	TArray<int32> AdjTriangles;
+	AdjTriangles.SetNumUninitialized(AdjOffsets[NumVertices]);
+	{
+		TArray<int32> Cursor(AdjOffsets.GetData(), NumVertices);
+		for (int32 I = 0; I < NumTris * 3; ++I)
+		{
+			AdjTriangles[Cursor[Indices[I]]++] = I / 3;
+		}
+	}
+
+	TArray<int32> CacheTime;
+	CacheTime.SetNumZeroed(NumVertices);
+	TBitArray<> Emitted(false, NumTris);
+	TArray<int32> DeadEndStack;
+	DeadEndStack.Reserve(Indices.Num());
+	TArray<int32> Candidates;
+	Candidates.Reserve(64);
+
+	TArray<uint32> Output;
+	Output.Reserve(NumTris * 3);
+
+	int32 TimeStamp = CacheSize + 1;
+	int32 ScanCursor = 1;
+	int32 Fanning = 0;
+
+	auto SkipDeadEnd = [&]()
+	{
+		while (DeadEndStack.Num() > 0)
+		{
+			const int32 V = DeadEndStack.Pop(false);
+			if (LiveTriangles[V] > 0)
+			{
+				return V;
+			}
+		}
+		for (; ScanCursor < NumVertices; ++ScanCursor)
+		{
+			if (LiveTriangles[ScanCursor] > 0)
+			{
+				return ScanCursor;
+			}
+		}
+		return static_cast<int32>(INDEX_NONE);
+	};
+
+	while (Fanning != INDEX_NONE)
+	{
+		Candidates.Reset();
+		for (int32 A = AdjOffsets[Fanning]; A < AdjOffsets[Fanning + 1]; ++A)
+		{
+			const int32 Tri = AdjTriangles[A];
+			if (Emitted[Tri])
+			{
+				continue;
+			}
+			Emitted[Tri] = true;
+
+			for (int32 Corner = 0; Corner < 3; ++Corner)
+			{
+				const uint32 V = Indices[Tri * 3 + Corner];
+				Output.Add(V);
+				DeadEndStack.Add(V);
+				Candidates.Add(V);
+				--LiveTriangles[V];
+				if (TimeStamp - CacheTime[V] > CacheSize)
+				{
+					CacheTime[V] = TimeStamp++;
+				}
+			}
+		}
+
+		// Prefer the candidate that is still in cache and will stay there while its fan is emitted.
+		int32 Next = INDEX_NONE;
+		int32 BestPriority = -1;
+		for (const int32 V : Candidates)
+		{
+			if (LiveTriangles[V] <= 0)
+			{
+				continue;
+			}
+			int32 Priority = 0;
+			if (TimeStamp - CacheTime[V] + 2 * LiveTriangles[V] <= CacheSize)
+			{
+				Priority = TimeStamp - CacheTime[V];
+			}
+			if (Priority > BestPriority)
+			{
+				BestPriority = Priority;
+				Next = V;
+			}
+		}
+
+		Fanning = INDEX_NONE != Next ? Next : SkipDeadEnd();
+	}
+
+	check(Output.Num() == NumTris * 3);
+	Indices = MoveTemp(Output);
+}
+
+#pragma endregion Reordering
@@ -3,8 +3,12 @@
 
 #include "ClothMeshComponent.h"
 
+#include "ClothBatchRenderer.h"
+#include "ClothMeshBuilder.h"
 #include "DynamicMeshBuilder.h"
 #include "MeshMaterialShader.h"
+#include "Async/ParallelFor.h"
+#include "Net/UnrealNetwork.h"
 
 #pragma region Forward Decl
 class FClothMeshVertexFactoryShaderParameters;
@@ -128,10 +132,12 @@ IMPLEMENT_VERTEX_FACTORY_TYPE(FClothMeshVertexFactory, "/Plugin/CustomClothShade
 
 static void ConvertClothMeshToDynMeshVertex(FDynamicMeshVertex& OutVert, const FClothMeshVertex& InVert)
 {
-	OutVert.Position = static_cast<FVector3f>(InVert.Position);
+	OutVert.Position = InVert.Position;
 	OutVert.Color = InVert.Color;
 }
 
+static constexpr uint32 ClothNumTexCoords = 4;
+
 class FClothMeshProxyData
 {
 public:
@@ -224,9 +230,9 @@ public:
 				BatchElement.PrimitiveUniformBufferResource = &DynamicPrimitiveUniformBuffer.UniformBuffer;
 
 				BatchElement.FirstIndex = 0;
-				BatchElement.NumPrimitives = ProxyData.IndexBuffer.Indices.Num() / 3;
+				BatchElement.NumPrimitives = NumActiveIndices / 3;
 				BatchElement.MinVertexIndex = 0;
-				BatchElement.MaxVertexIndex = ProxyData.VertexBuffers.PositionVertexBuffer.GetNumVertices() - 1;
+				BatchElement.MaxVertexIndex = FMath::Max(NumActiveVertices - 1, 0);
 				Mesh.ReverseCulling = IsLocalToWorldDeterminantNegative();
 				Mesh.Type = PT_TriangleList;
 				Mesh.DepthPriorityGroup = SDPG_World;
@@ -263,7 +269,11 @@ public:
 		
 		const int32 NumVerts = VertexBuffer.Num();
 
+		// Streams are sized for the particles tearing may still add, so the first tear does not reallocate them.
+		const int32 Capacity = FMath::Max(InComponent->GetParticleCapacity(), NumVerts);
+
 		TArray<FDynamicMeshVertex> Vertices;
+		Vertices.Reserve(Capacity);
 		Vertices.SetNumUninitialized(NumVerts);
 		// Copy verts
 		for (int VertIdx = 0; VertIdx < NumVerts; VertIdx++)
@@ -271,11 +281,20 @@ public:
 			const FClothMeshVertex& ClothMeshVertex = VertexBuffer[VertIdx];
 			FDynamicMeshVertex& Vert = Vertices[VertIdx];
 			ConvertClothMeshToDynMeshVertex(Vert, ClothMeshVertex);
+			Vert.Position += FVector3f(InComponent->SimulationOrigin);
+		}
+		while (Vertices.Num() < Capacity)
+		{
+			Vertices.Emplace(FVector3f::ZeroVector);
 		}
 
 		// Copy indices
 		ProxyData.IndexBuffer.Indices = IndexBuffer;
-		ProxyData.VertexBuffers.InitFromDynamicVertex(&VertexFactory, Vertices, 4);
+		ProxyData.VertexBuffers.InitFromDynamicVertex(&VertexFactory, Vertices, ClothNumTexCoords);
+
+		VertexCapacity = Capacity;
+		NumActiveVertices = NumVerts;
+		NumActiveIndices = IndexBuffer.Num();
 
 		BeginInitResource(&ProxyData.VertexBuffers.PositionVertexBuffer);
 		BeginInitResource(&ProxyData.VertexBuffers.StaticMeshVertexBuffer);
@@ -289,37 +308,108 @@ public:
 		}
 	}
 
-	void SetMeshData_RenderThread(FClothMeshData* ClothMeshData)
+	void SetMeshData_RenderThread(const FClothMeshRenderPayload& Payload)
 	{
 		check(IsInRenderingThread());
 
-		const int32 NumVerts = ClothMeshData->VertexBuffer.Num();
-		for (int32 Idx = 0; Idx < NumVerts; ++Idx)
+		auto& PositionBuffer = ProxyData.VertexBuffers.PositionVertexBuffer;
+		auto& ColorBuffer = ProxyData.VertexBuffers.ColorVertexBuffer;
+
+		if (Payload.bTopologyDirty)
 		{
-			const FClothMeshVertex& NewVert = ClothMeshData->VertexBuffer[Idx];
-			FDynamicMeshVertex Vertex;
-			ConvertClothMeshToDynMeshVertex(Vertex, NewVert);
+			SetTopology_RenderThread(Payload);
+		}
 
-			ProxyData.VertexBuffers.PositionVertexBuffer.VertexPosition(Idx) = Vertex.Position;
-			ProxyData.VertexBuffers.ColorVertexBuffer.VertexColor(Idx) = Vertex.Color;
+		const int32 NumVerts = FMath::Min<int32>(Payload.Positions.Num(), NumActiveVertices);
+		for (int32 Idx = 0; Idx < NumVerts; ++Idx)
+		{
+			PositionBuffer.VertexPosition(Idx) = Payload.Positions[Idx];
+		}
+		UploadBuffer_RenderThread(PositionBuffer.VertexBufferRHI, PositionBuffer.GetVertexData(), NumVerts * PositionBuffer.GetStride());
 
+		if (Payload.bTopologyDirty)
+		{
+			const int32 NumColors = FMath::Min<int32>(Payload.Colors.Num(), NumActiveVertices);
+			for (int32 Idx = 0; Idx < NumColors; ++Idx)
 			{
-				auto& VertexBuffer = ProxyData.VertexBuffers.PositionVertexBuffer;
-				void* VertexBufferData = RHILockBuffer(VertexBuffer.VertexBufferRHI, 0, VertexBuffer.GetNumVertices() * VertexBuffer.GetStride(), RLM_WriteOnly);
-				FMemory::Memcpy(VertexBufferData, VertexBuffer.GetVertexData(), VertexBuffer.GetNumVertices() * VertexBuffer.GetStride());
-				RHIUnlockBuffer(VertexBuffer.VertexBufferRHI);
+				ColorBuffer.VertexColor(Idx) = Payload.Colors[Idx];
 			}
-			
+			UploadBuffer_RenderThread(ColorBuffer.VertexBufferRHI, ColorBuffer.GetVertexData(), NumColors * ColorBuffer.GetStride());
+		}
+	}
+
+private:
+	static void UploadBuffer_RenderThread(FRHIBuffer* Buffer, const void* Data, const uint32 Size)
+	{
+		if (nullptr == Buffer || Size == 0)
+		{
+			return;
+		}
+		void* BufferData = RHILockBuffer(Buffer, 0, Size, RLM_WriteOnly);
+		FMemory::Memcpy(BufferData, Data, Size);
+		RHIUnlockBuffer(Buffer);
+	}
+
+	/**
+	 * Resize in place. GPU buffers are only reallocated when a count exceeds the capacity, which then grows by half,
+	 * so topology edits such as tearing or resolution changes neither recreate the proxy nor the vertex factory.
+	 */
+	void SetTopology_RenderThread(const FClothMeshRenderPayload& Payload)
+	{
+		auto& PositionBuffer = ProxyData.VertexBuffers.PositionVertexBuffer;
+		auto& StaticMeshBuffer = ProxyData.VertexBuffers.StaticMeshVertexBuffer;
+		auto& ColorBuffer = ProxyData.VertexBuffers.ColorVertexBuffer;
+
+		const int32 NumVerts = Payload.Positions.Num();
+		if (NumVerts > VertexCapacity)
+		{
+			VertexCapacity = FMath::Max(NumVerts, VertexCapacity + VertexCapacity / 2);
+
+			PositionBuffer.Init(VertexCapacity);
+			ColorBuffer.Init(VertexCapacity);
+			StaticMeshBuffer.Init(VertexCapacity, ClothNumTexCoords);
+			for (int32 Idx = 0; Idx < VertexCapacity; ++Idx)
 			{
-				auto& VertexBuffer = ProxyData.VertexBuffers.ColorVertexBuffer;
-				void* VertexBufferData = RHILockBuffer(VertexBuffer.VertexBufferRHI, 0, VertexBuffer.GetNumVertices() * VertexBuffer.GetStride(), RLM_WriteOnly);
-				FMemory::Memcpy(VertexBufferData, VertexBuffer.GetVertexData(), VertexBuffer.GetNumVertices() * VertexBuffer.GetStride());
-				RHIUnlockBuffer(VertexBuffer.VertexBufferRHI);
+				PositionBuffer.VertexPosition(Idx) = FVector3f::ZeroVector;
+				ColorBuffer.VertexColor(Idx) = FColor::White;
+				StaticMeshBuffer.SetVertexTangents(Idx, FVector3f(1, 0, 0), FVector3f(0, 1, 0), FVector3f(0, 0, 1));
+				for (uint32 UV = 0; UV < ClothNumTexCoords; ++UV)
+				{
+					StaticMeshBuffer.SetVertexUV(Idx, UV, FVector2f::ZeroVector);
+				}
 			}
+
+			PositionBuffer.UpdateRHI();
+			ColorBuffer.UpdateRHI();
+			StaticMeshBuffer.UpdateRHI();
+
+			// Same factory, only the stream bindings are refreshed.
+			FLocalVertexFactory::FDataType Data;
+			PositionBuffer.BindPositionVertexBuffer(&VertexFactory, Data);
+			StaticMeshBuffer.BindTangentVertexBuffer(&VertexFactory, Data);
+			StaticMeshBuffer.BindPackedTexCoordVertexBuffer(&VertexFactory, Data);
+			StaticMeshBuffer.BindLightMapVertexBuffer(&VertexFactory, Data, 0);
+			ColorBuffer.BindColorVertexBuffer(&VertexFactory, Data);
+			VertexFactory.SetData(Data);
+		}
+		NumActiveVertices = NumVerts;
+
+		TArray<uint32>& Indices = ProxyData.IndexBuffer.Indices;
+		const int32 NumIndices = Payload.Indices.Num();
+		if (NumIndices > Indices.Num())
+		{
+			Indices.SetNumZeroed(FMath::Max(NumIndices, Indices.Num() + Indices.Num() / 2));
+			FMemory::Memcpy(Indices.GetData(), Payload.Indices.GetData(), NumIndices * sizeof(uint32));
+			ProxyData.IndexBuffer.UpdateRHI();
 		}
+		else
+		{
+			FMemory::Memcpy(Indices.GetData(), Payload.Indices.GetData(), NumIndices * sizeof(uint32));
+			UploadBuffer_RenderThread(ProxyData.IndexBuffer.IndexBufferRHI, Indices.GetData(), NumIndices * sizeof(uint32));
+		}
+		NumActiveIndices = NumIndices;
 	}
 
-private:
 	FMaterialRelevance MaterialRelevance;
 	UMaterialInterface* MaterialInterface = nullptr;
 
@@ -328,31 +418,116 @@ private:
 	FClothMeshProxyData ProxyData;
 
 	FLocalVertexFactory VertexFactory;
+
+	/** Buffers may be larger than what is drawn, see SetTopology_RenderThread. */
+	int32 VertexCapacity = 0;
+	int32 NumActiveVertices = 0;
+	int32 NumActiveIndices = 0;
 };
 #pragma endregion Proxies
 
+// Vertices integrated per task, each task also produces one partial AABB.
+static constexpr int32 IntegrationChunkSize = 1024;
+
+// Particle data per replicated packet, far below the bunch size limit and about one second of the default budget.
+static constexpr int32 MaxReplicationPacketBytes = 8 * 1024;
+
 #pragma region Component
+bool FClothStatePacket::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	constexpr uint32 MaxPacketBytes = 1 << 20;
+
+	Ar.SerializeIntPacked(Frame);
+	Ar.SerializeIntPacked(BaseFrame);
+
+	uint32 NumBytes = Data.Num();
+	Ar.SerializeIntPacked(NumBytes);
+	if (Ar.IsLoading())
+	{
+		if (NumBytes > MaxPacketBytes)
+		{
+			Ar.SetError();
+			bOutSuccess = false;
+			return true;
+		}
+		Data.SetNumUninitialized(NumBytes);
+	}
+	Ar.Serialize(Data.GetData(), NumBytes);
+
+	bOutSuccess = !Ar.IsError();
+	return true;
+}
+
 void UClothMeshComponent::RecreateMesh()
 {
 	RecreateMeshData();
+
+	// Resize the live proxy in place rather than recreating it.
+	SendMeshDataToRenderThread(true);
 }
 
-void UClothMeshComponent::SendMeshDataToRenderThread() const
+void UClothMeshComponent::SetClothResolution(const int32 InDestinyX, const int32 InDestinyY)
 {
-	// Do a copy
-	FClothMeshData* NewClothMesh = new FClothMeshData;
-	*NewClothMesh = ClothMesh;
+	DestinyX = FMath::Max(InDestinyX, 0);
+	DestinyY = FMath::Max(InDestinyY, 0);
+	RecreateMesh();
+}
 
-	// enqueue command
-	if (FClothMeshSceneProxy* ClothMeshSceneProxy = static_cast<FClothMeshSceneProxy*>(SceneProxy))
+void UClothMeshComponent::SetClothSize(const FVector2D InClothSize)
+{
+	ClothSize = InClothSize;
+	RecreateMesh();
+}
+
+void UClothMeshComponent::SetPinTarget(USceneComponent* InPinTarget)
+{
+	if (USceneComponent* OldTarget = GetPinTarget())
 	{
-		ENQUEUE_RENDER_COMMAND(FClothMeshData)(
-			[ClothMeshSceneProxy, NewClothMesh] (FRHICommandListImmediate& RHICmdList)
-			{
-				ClothMeshSceneProxy->SetMeshData_RenderThread(NewClothMesh);
-			}
-		);
+		RemoveTickPrerequisiteComponent(OldTarget);
 	}
+
+	PinTarget = InPinTarget;
+	Pinning.Reset();
+
+	// Sample the pose after the target has been animated this frame.
+	if (USceneComponent* NewTarget = GetPinTarget())
+	{
+		AddTickPrerequisiteComponent(NewTarget);
+	}
+}
+
+USceneComponent* UClothMeshComponent::GetPinTarget() const
+{
+	return nullptr != PinTarget ? PinTarget : GetAttachParent();
+}
+
+void UClothMeshComponent::SendMeshDataToRenderThread(const bool bTopologyChanged) const
+{
+	if (nullptr != RenderBatch)
+	{
+		RenderBatch->UpdateCloth(this, bTopologyChanged);
+		return;
+	}
+
+	FClothMeshSceneProxy* ClothMeshSceneProxy = static_cast<FClothMeshSceneProxy*>(SceneProxy);
+	if (nullptr == ClothMeshSceneProxy)
+	{
+		return;
+	}
+
+	// Payloads come back from the render thread, only the first few frames allocate.
+	FClothMeshRenderPayload* Payload = PayloadPool->Acquire();
+	// The proxy draws in component space, the origin is small there and float is good enough for drawing.
+	Payload->CopyFrom(ClothMesh, bTopologyChanged, FVector3f(SimulationOrigin));
+
+	// enqueue command
+	ENQUEUE_RENDER_COMMAND(FClothMeshData)(
+		[ClothMeshSceneProxy, Payload, Pool = PayloadPool] (FRHICommandListImmediate& RHICmdList)
+		{
+			ClothMeshSceneProxy->SetMeshData_RenderThread(*Payload);
+			Pool->Release(Payload);
+		}
+	);
 }
 
 void UClothMeshComponent::TickComponent(float DeltaTime, ELevelTick TickType,
@@ -362,23 +537,175 @@ void UClothMeshComponent::TickComponent(float DeltaTime, ELevelTick TickType,
 
 	if (TickType != LEVELTICK_All) return;
 
+	bool bTorn = false;
+	if (bDeterministic)
+	{
+		// Fixed steps only, the frame time decides how many run but never what they compute.
+		StepAccumulator = FMath::Min(StepAccumulator + DeltaTime, FixedTimeStep * MaxSubsteps);
+		while (StepAccumulator >= FixedTimeStep)
+		{
+			StepAccumulator -= FixedTimeStep;
+			bTorn |= StepSimulation(FixedTimeStep);
+		}
+	}
+	else
+	{
+		bTorn = StepSimulation(DeltaTime);
+	}
+
+	UpdateReplicationBudget(DeltaTime, bTorn);
+
+	SendMeshDataToRenderThread(bTorn);
+	
+}
+
+bool UClothMeshComponent::StepSimulation(const float DeltaTime)
+{
+	FrameArena.Reset();
+
 	for (const auto& Spring : Springs)
 	{
-		Spring.ApplyForce(DeltaTime, FVector{0, 0, 0.098f});
+		Spring.ApplyForce(DeltaTime, FVector3f{0, 0, 0.098f});
 	}
 
-	for (auto& Vertex : ClothMesh.VertexBuffer)
+	if (bEnableAerodynamics)
 	{
-		Vertex.Position += Vertex.Velocity * DeltaTime;
+		const float WindTime = bDeterministic ? SimulationFrame * FixedTimeStep : GetWorld()->GetTimeSeconds();
+		Aerodynamics.WindCache.Resolution = WindCacheResolution;
+		Aerodynamics.WindCache.RefreshInterval = WindCacheRefreshInterval;
+		Aerodynamics.WindCache.Update(GetWorld(), GetSimulationToWorld(), LocalBounds.GetBox(), WindTime, DeltaTime, WindVelocityScale);
+		Aerodynamics.Apply(ClothMesh, DeltaTime, AirDensity, FrameArena);
 	}
-	
-	SendMeshDataToRenderThread();
-	
+
+	if (PinAttachments.Num() > 0)
+	{
+		const USceneComponent* Target = GetPinTarget();
+		if (!Pinning.IsBound())
+		{
+			Pinning.Bind(ClothMesh, PinAttachments, Target, GetSimulationToWorld());
+		}
+		Pinning.Apply(ClothMesh, Target, GetSimulationToWorld(), DeltaTime);
+	}
+
+	// Clients take the origin from the server, see OnRep_ClothDelta.
+	FBox SimulatedBox = IntegratePositions(DeltaTime);
+	if (!IsClothStateProxy() && RebaseSimulation(SimulatedBox))
+	{
+		SimulatedBox = SimulatedBox.ShiftBy(-LastRebaseShift);
+	}
+	UpdateDynamicBounds(SimulatedBox);
+
+	++SimulationFrame;
+
+	// Clients have to keep the server topology, their particle count must match the replicated state.
+	return CanTear() && Tearing.Step(ClothMesh, Springs, TearBreakRatio, MaxTearsPerFrame) > 0;
+}
+
+bool UClothMeshComponent::IsClothStateAuthority() const
+{
+	return bReplicateClothState && GetIsReplicated() && GetOwnerRole() == ROLE_Authority;
+}
+
+bool UClothMeshComponent::IsClothStateProxy() const
+{
+	return bReplicateClothState && GetIsReplicated() && GetOwnerRole() != ROLE_Authority;
+}
+
+void UClothMeshComponent::UpdateReplicationBudget(const float DeltaTime, const bool bTopologyChanged)
+{
+	if (!IsClothStateAuthority())
+	{
+		return;
+	}
+
+	// Token bucket that may run into debt, so a packet larger than what is left still goes out.
+	const float Budget = static_cast<float>(ReplicationBytesPerSecond);
+	ReplicationCredit = FMath::Min(ReplicationCredit + Budget * DeltaTime, Budget);
+	TimeSinceKeyframe += DeltaTime;
+	bKeyframeDirty |= bTopologyChanged;
+}
+
+void UClothMeshComponent::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+	Super::PreReplication(ChangedPropertyTracker);
+
+	// Encoded here rather than every tick, only the packet a net update actually sends is charged.
+	if (!IsClothStateAuthority() || ReplicationCredit <= 0.f)
+	{
+		return;
+	}
+
+	// A rebase moves the space the keyframe was quantized in, a keyframe still going out is restarted.
+	const bool bKeyframeDue = bKeyframeDirty || !StateCodec.HasKeyframe() || (!StateCodec.IsSendingKeyframe() && TimeSinceKeyframe >= KeyframeInterval);
+	if (!bKeyframeDue && !StateCodec.IsSendingKeyframe())
+	{
+		if (StateCodec.EncodeDelta(ClothMesh, SimulationFrame, MaxReplicationPacketBytes, PendingPacket))
+		{
+			ReplicationCredit -= PendingPacket.Data.Num();
+			Swap(ClothDelta, PendingPacket);
+			return;
+		}
+	}
+
+	if (!StateCodec.IsSendingKeyframe() || bKeyframeDue)
+	{
+		StateCodec.BeginKeyframe(ClothMesh, LocalBounds.GetBox(), SimulationOrigin, SimulationFrame);
+		bKeyframeDirty = false;
+	}
+
+	StateCodec.EncodeKeyframeChunk(MaxReplicationPacketBytes, PendingPacket);
+	ReplicationCredit -= PendingPacket.Data.Num();
+	Swap(ClothKeyframe, PendingPacket);
+
+	// The interval runs from the last chunk, so a keyframe that takes longer than it to send is not restarted halfway.
+	TimeSinceKeyframe = 0.f;
+}
+
+void UClothMeshComponent::OnRep_ClothKeyframe()
+{
+	if (StateCodec.DecodeKeyframe(ClothKeyframe, ClothMesh))
+	{
+		SimulationFrame = ClothKeyframe.Frame;
+		SimulationOrigin = StateCodec.GetOrigin();
+		Aerodynamics.WindCache.Invalidate();
+		UpdateLocalBounds();
+		SendMeshDataToRenderThread();
+	}
+}
+
+void UClothMeshComponent::OnRep_ClothDelta()
+{
+	// Deltas against another keyframe than the one we hold are dropped, the next keyframe resyncs.
+	// The origin only changes with keyframes, which replace every particle, a delta chunk covers only some of them.
+	if (StateCodec.DecodeDelta(ClothDelta, ClothMesh))
+	{
+		SimulationFrame = ClothDelta.Frame;
+		SendMeshDataToRenderThread();
+	}
+}
+
+void UClothMeshComponent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(UClothMeshComponent, ClothKeyframe);
+	DOREPLIFETIME(UClothMeshComponent, ClothDelta);
 }
 
 void UClothMeshComponent::BeginPlay()
 {
 	Super::BeginPlay();
+
+	if (USceneComponent* Target = GetPinTarget(); nullptr != Target && PinAttachments.Num() > 0)
+	{
+		AddTickPrerequisiteComponent(Target);
+	}
+
+	if (bReplicateClothState)
+	{
+		SetIsReplicated(true);
+		UE_CLOG(bEnableTearing, LogTemp, Warning, TEXT("ClothMeshComponent: %s replicates its state, tearing is not supported and stays off."), *GetPathName());
+	}
 }
 
 void UClothMeshComponent::InitializeComponent()
@@ -388,6 +715,7 @@ void UClothMeshComponent::InitializeComponent()
 }
 
 UClothMeshComponent::UClothMeshComponent(const FObjectInitializer& Initializer)
+	: PayloadPool(MakeShared<FClothRenderPayloadPool, ESPMode::ThreadSafe>())
 {
 	PrimaryComponentTick.bCanEverTick = true;
 	PrimaryComponentTick.bStartWithTickEnabled = true;
@@ -404,8 +732,8 @@ void UClothMeshComponent::GeneratePhysicalVertex()
 	{
 		for (int32 Y = 0; Y < DestinyY; ++Y)
 		{
-			const FVector Pos { Padding * FVector2D{ static_cast<double>(X), static_cast<double>(Y) }, .0f };
-			ClothMesh.VertexBuffer.Add(FClothMeshVertex { Pos });
+			const FVector2D Planar = Padding * FVector2D{ static_cast<double>(X), static_cast<double>(Y) };
+			ClothMesh.VertexBuffer.Add(FClothMeshVertex { FVector3f{ static_cast<float>(Planar.X), static_cast<float>(Planar.Y), .0f } });
 		}
 	}
 	
@@ -454,10 +782,12 @@ void UClothMeshComponent::GeneratePhysicalVertex()
 
 	if (Nums == 0)
 	{
+		const float SizeX = ClothSize.X;
+		const float SizeY = ClothSize.Y;
 		ClothMesh.VertexBuffer.Add(FClothMeshVertex{ { .0f, .0f, .0f} });
-		ClothMesh.VertexBuffer.Add(FClothMeshVertex{ { ClothSize.X, .0f, .0f} });
-		ClothMesh.VertexBuffer.Add(FClothMeshVertex{ { .0f, ClothSize.Y, .0f} });
-		ClothMesh.VertexBuffer.Add(FClothMeshVertex{ { ClothSize.X, ClothSize.Y, .0f} });
+		ClothMesh.VertexBuffer.Add(FClothMeshVertex{ { SizeX, .0f, .0f} });
+		ClothMesh.VertexBuffer.Add(FClothMeshVertex{ { .0f, SizeY, .0f} });
+		ClothMesh.VertexBuffer.Add(FClothMeshVertex{ { SizeX, SizeY, .0f} });
 		
 		ClothMesh.IndexBuffer.Append({
 			0, 2, 1,
@@ -466,9 +796,46 @@ void UClothMeshComponent::GeneratePhysicalVertex()
 	}
 }
 
+bool UClothMeshComponent::GeneratePhysicalVertexFromStaticMesh()
+{
+	FClothStaticMeshBuildParams Params;
+	Params.LODIndex = SourceLODIndex;
+	Params.SectionIndex = SourceSectionIndex;
+	Params.WeldThreshold = WeldThreshold;
+	Params.PinColor = PinVertexColor;
+	Params.PinColorTolerance = PinColorTolerance;
+
+	TArray<FClothSpringDesc> SpringDescs;
+	if (!FClothMeshBuilder::BuildFromStaticMesh(SourceMesh, Params, ClothMesh, SpringDescs))
+	{
+		ClothMesh.Reset();
+		return false;
+	}
+
+	// Vertex buffer is final from here on, springs may keep pointers into it.
+	Springs.Empty(SpringDescs.Num());
+	for (const auto& [A, B, RestLength, Type] : SpringDescs)
+	{
+		FClothMassString NewSpring { RestLength, &ClothMesh.VertexBuffer[A], &ClothMesh.VertexBuffer[B] };
+		if (Type == ESpringType::Shear)
+		{
+			NewSpring.SetParamPercent(0.7f, 1.0f);
+		}
+		else if (Type == ESpringType::Bending)
+		{
+			NewSpring.SetParamPercent(0.3f, 1.0f);
+		}
+		Springs.Add(NewSpring);
+	}
+
+	return true;
+}
+
 void UClothMeshComponent::RecreateMeshData()
 {
 	ClothMesh.Reset();
+	SimulationOrigin = FVector::ZeroVector;
+	Aerodynamics.WindCache.Invalidate();
 
 	const FVector LocalCenter = FVector::ZeroVector;
 	const FVector LocalXAxis {1.0, .0, .0};
@@ -479,7 +846,14 @@ void UClothMeshComponent::RecreateMeshData()
 	FVector XOffset = LocalXAxis * Width * .5f;
 	FVector YOffset = LocalYAxis * Height * .5f;
 
-	GeneratePhysicalVertex();
+	if (nullptr == SourceMesh || !GeneratePhysicalVertexFromStaticMesh())
+	{
+		GeneratePhysicalVertex();
+	}
+
+	Tearing.Build(ClothMesh, Springs, CanTear() ? TearCapacity : 0);
+	Pinning.Build(ClothMesh);
+	Aerodynamics.Build(ClothMesh);
 
 	UpdateLocalBounds();
 }
@@ -490,27 +864,166 @@ void UClothMeshComponent::UpdateLocalBounds()
 
 	for (const auto& MeshVertex : ClothMesh.VertexBuffer)
 	{
-		const FVector Pos { MeshVertex.Position.X, MeshVertex.Position.Y, MeshVertex.Position.Z };
-		LocalBox += Pos;
+		LocalBox += FVector(MeshVertex.Position);
 	}
 
 	LocalBounds = LocalBox.IsValid ? FBoxSphereBounds(LocalBox) : FBoxSphereBounds{ {}, {},  0};
 
-	UpdateBounds();
-	MarkRenderTransformDirty();
+	SendBoundsToRenderThread();
+}
+
+FBox UClothMeshComponent::IntegratePositions(const float DeltaTime)
+{
+	TArray<FClothMeshVertex>& VertexBuffer = ClothMesh.VertexBuffer;
+	const int32 NumVerts = VertexBuffer.Num();
+	if (NumVerts == 0)
+	{
+		return FBox(ForceInit);
+	}
+
+	const int32 NumChunks = FMath::DivideAndRoundUp(NumVerts, IntegrationChunkSize);
+	TArrayView<FVector3f> PartialMin = FrameArena.Alloc<FVector3f>(NumChunks);
+	TArrayView<FVector3f> PartialMax = FrameArena.Alloc<FVector3f>(NumChunks);
+
+	// The bounds reduction rides along with the position write, the data is already in registers.
+	ParallelFor(NumChunks, [&VertexBuffer, &PartialMin, &PartialMax, NumVerts, DeltaTime](const int32 Chunk)
+	{
+		const int32 First = Chunk * IntegrationChunkSize;
+		const int32 Last = FMath::Min(First + IntegrationChunkSize, NumVerts);
+
+		const VectorRegister4Float Dt = VectorSetFloat1(DeltaTime);
+		VectorRegister4Float Min = VectorSetFloat1(TNumericLimits<float>::Max());
+		VectorRegister4Float Max = VectorSetFloat1(TNumericLimits<float>::Lowest());
+
+		for (int32 Idx = First; Idx < Last; ++Idx)
+		{
+			FClothMeshVertex& Vertex = VertexBuffer[Idx];
+			const VectorRegister4Float Position = VectorMultiplyAdd(VectorLoadFloat3_W0(&Vertex.Velocity.X), Dt, VectorLoadFloat3_W0(&Vertex.Position.X));
+			VectorStoreFloat3(Position, &Vertex.Position.X);
+			Min = VectorMin(Min, Position);
+			Max = VectorMax(Max, Position);
+		}
+
+		VectorStoreFloat3(Min, &PartialMin[Chunk].X);
+		VectorStoreFloat3(Max, &PartialMax[Chunk].X);
+	}, NumChunks == 1 ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+
+	// Merge in chunk order so the result does not depend on scheduling.
+	FBox3f Box(PartialMin[0], PartialMax[0]);
+	for (int32 Chunk = 1; Chunk < NumChunks; ++Chunk)
+	{
+		Box.Min = Box.Min.ComponentMin(PartialMin[Chunk]);
+		Box.Max = Box.Max.ComponentMax(PartialMax[Chunk]);
+	}
+	return FBox(Box);
+}
+
+void UClothMeshComponent::UpdateDynamicBounds(const FBox& SimulatedBox)
+{
+	if (!SimulatedBox.IsValid)
+	{
+		return;
+	}
+
+	// Keep the current bounds while they contain the cloth and are not more than twice the slack too large.
+	const FVector Slack { SimulatedBox.GetExtent().GetMax() * BoundsSlack + KINDA_SMALL_NUMBER };
+	const FBox CurrentBox = LocalBounds.GetBox();
+	if (CurrentBox.IsInside(SimulatedBox) && SimulatedBox.ExpandBy(Slack * 2.0).IsInside(CurrentBox))
+	{
+		return;
+	}
+
+	LocalBounds = FBoxSphereBounds(SimulatedBox.ExpandBy(Slack));
+	SendBoundsToRenderThread();
+}
+
+bool UClothMeshComponent::RebaseSimulation(const FBox& SimulatedBox)
+{
+	if (RebaseDistance <= 0.f || !SimulatedBox.IsValid)
+	{
+		return false;
+	}
+
+	const FVector Center = SimulatedBox.GetCenter();
+	if (Center.SizeSquared() < FMath::Square(static_cast<double>(RebaseDistance)))
+	{
+		return false;
+	}
+
+	// Shift by a float representable amount so every particle moves by exactly the same offset.
+	const FVector3f Shift(Center);
+	for (FClothMeshVertex& Vertex : ClothMesh.VertexBuffer)
+	{
+		Vertex.Position -= Shift;
+	}
+
+	LastRebaseShift = FVector(Shift);
+	SimulationOrigin += LastRebaseShift;
+	LocalBounds.Origin -= LastRebaseShift;
+	Aerodynamics.WindCache.Invalidate();
+	bKeyframeDirty = true;
+
+	// Component space bounds did not move, the uploaded positions include the origin.
+	return true;
+}
+
+void UClothMeshComponent::SendBoundsToRenderThread()
+{
+	// Goes straight to UpdatePrimitiveTransform, no render state recreation and no end of frame dirty pass.
+	if (IsRenderStateCreated())
+	{
+		SendRenderTransform_Concurrent();
+	}
+	else
+	{
+		UpdateBounds();
+	}
+}
+
+FVector UClothMeshComponent::GetParticleLocation(const int32 ParticleIndex) const
+{
+	if (!ClothMesh.VertexBuffer.IsValidIndex(ParticleIndex))
+	{
+		return GetComponentLocation();
+	}
+	return GetSimulationToWorld().TransformPosition(FVector(ClothMesh.VertexBuffer[ParticleIndex].Position));
 }
 
 FPrimitiveSceneProxy* UClothMeshComponent::CreateSceneProxy()
 {
+	// Batched cloths are drawn by their UClothBatchComponent.
+	if (bBatchRendering)
+	{
+		return nullptr;
+	}
 	return new FClothMeshSceneProxy(this);
 }
 
 void UClothMeshComponent::OnRegister()
 {
+	if (UWorld* World = GetWorld(); bBatchRendering && nullptr != World)
+	{
+		if (UClothBatchSubsystem* BatchSubsystem = World->GetSubsystem<UClothBatchSubsystem>())
+		{
+			RenderBatch = BatchSubsystem->AddCloth(this);
+		}
+	}
+
 	RecreateMesh();
 	Super::OnRegister();
 }
 
+void UClothMeshComponent::OnUnregister()
+{
+	if (nullptr != RenderBatch)
+	{
+		RenderBatch->RemoveCloth(this);
+		RenderBatch = nullptr;
+	}
+
+	Super::OnUnregister();
+}
+
 int32 UClothMeshComponent::GetNumMaterials() const
 {
 	return Super::GetNumMaterials();
@@ -518,7 +1031,8 @@ int32 UClothMeshComponent::GetNumMaterials() const
 
 FBoxSphereBounds UClothMeshComponent::CalcBounds(const FTransform& LocalToWorld) const
 {
-	FBoxSphereBounds BoxBounds(LocalBounds.TransformBy(LocalToWorld));
+	// LocalBounds are in simulation space.
+	FBoxSphereBounds BoxBounds(LocalBounds.TransformBy(FTransform(SimulationOrigin) * LocalToWorld));
 
 	BoxBounds.BoxExtent *= BoundsScale;
 	BoxBounds.SphereRadius *= BoundsScale;
@@ -0,0 +1,169 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ClothPinning.h"
+
+#include "ClothMeshComponent.h"
+#include "Components/SkinnedMeshComponent.h"
+#include "Engine/SkeletalMeshSocket.h"
+
+static const TArray<FTransform>* GetBoneTransforms(const USceneComponent* Target)
+{
+	const USkinnedMeshComponent* Skinned = Cast<USkinnedMeshComponent>(Target);
+	return Skinned ? &Skinned->GetComponentSpaceTransforms() : nullptr;
+}
+
+void FClothPinning::Build(const FClothMeshData& Mesh)
+{
+	DefaultPinned.Reset();
+	for (int32 V = 0; V < Mesh.VertexBuffer.Num(); ++V)
+	{
+		if (Mesh.VertexBuffer[V].bDisablePhys)
+		{
+			DefaultPinned.Add(V);
+		}
+	}
+
+	Bindings.Reset();
+	Particles.Reset();
+	Offsets.Reset();
+	bBound = false;
+}
+
+void FClothPinning::Bind(FClothMeshData& Mesh, const TArray<FClothPinAttachment>& Attachments, const USceneComponent* Target, const FTransform& ClothToWorld)
+{
+	TArray<FClothMeshVertex>& VertexBuffer = Mesh.VertexBuffer;
+
+	// Undo what the previous binding did to the flags, so every bind starts from the pins of the built mesh.
+	// Unbound pins stand still, a socket velocity left over from the last binding would carry them away.
+	for (const int32 Particle : Particles)
+	{
+		VertexBuffer[Particle].bDisablePhys = false;
+	}
+	for (const int32 Particle : DefaultPinned)
+	{
+		VertexBuffer[Particle].bDisablePhys = true;
+		VertexBuffer[Particle].Velocity = FVector3f::ZeroVector;
+	}
+
+	Bindings.Reset();
+	Particles.Reset();
+	Offsets.Reset();
+	bBound = true;
+
+	if (nullptr == Target)
+	{
+		return;
+	}
+
+	const USkinnedMeshComponent* Skinned = Cast<USkinnedMeshComponent>(Target);
+	const TArray<FTransform>* BoneTransforms = GetBoneTransforms(Target);
+
+	for (const FClothPinAttachment& Attachment : Attachments)
+	{
+		FBinding& Binding = Bindings.AddDefaulted_GetRef();
+		Binding.SocketName = Attachment.SocketName;
+		Binding.Compliance = FMath::Max(Attachment.Compliance, 0.f);
+		Binding.First = Particles.Num();
+
+		// Resolve sockets to their bone once, the per-frame read is then a plain array lookup.
+		if (nullptr != Skinned && Attachment.SocketName != NAME_None)
+		{
+			Binding.BoneIndex = Skinned->GetBoneIndex(Attachment.SocketName);
+			if (INDEX_NONE == Binding.BoneIndex)
+			{
+				if (const USkeletalMeshSocket* Socket = Skinned->GetSocketByName(Attachment.SocketName))
+				{
+					Binding.BoneIndex = Skinned->GetBoneIndex(Socket->BoneName);
+					Binding.SocketToBone = Socket->GetSocketLocalTransform();
+				}
+			}
+		}
+
+		if (Attachment.Particles.Num() > 0)
+		{
+			for (const int32 Particle : Attachment.Particles)
+			{
+				if (VertexBuffer.IsValidIndex(Particle))
+				{
+					Particles.Add(Particle);
+				}
+			}
+		}
+		else
+		{
+			// Not the live flags, an earlier soft attachment may have cleared them.
+			Particles.Append(DefaultPinned);
+		}
+
+		const FTransform SocketToCloth = GetSocketToCloth(Binding, Target, ClothToWorld, BoneTransforms);
+		for (int32 I = Binding.First; I < Particles.Num(); ++I)
+		{
+			FClothMeshVertex& Vertex = VertexBuffer[Particles[I]];
+			Offsets.Add(FVector3f(SocketToCloth.InverseTransformPosition(FVector(Vertex.Position))));
+
+			// Hard pins are fully kinematic, soft pins stay simulated and are pulled towards the socket.
+			Vertex.bDisablePhys = Binding.Compliance <= 0.f;
+		}
+		Binding.Num = Particles.Num() - Binding.First;
+	}
+}
+
+void FClothPinning::Apply(FClothMeshData& Mesh, const USceneComponent* Target, const FTransform& ClothToWorld, const float DeltaTime)
+{
+	if (nullptr == Target || Particles.Num() == 0 || DeltaTime <= 0.f)
+	{
+		return;
+	}
+
+	// One read of the whole pose serves every attachment.
+	const TArray<FTransform>* BoneTransforms = GetBoneTransforms(Target);
+	TArray<FClothMeshVertex>& VertexBuffer = Mesh.VertexBuffer;
+
+	for (const FBinding& Binding : Bindings)
+	{
+		// Relative to the simulation space the matrix is small, float keeps up with the particles.
+		const FMatrix44f SocketToCloth(GetSocketToCloth(Binding, Target, ClothToWorld, BoneTransforms).ToMatrixWithScale());
+		const VectorRegister4Float Row0 = VectorLoad(SocketToCloth.M[0]);
+		const VectorRegister4Float Row1 = VectorLoad(SocketToCloth.M[1]);
+		const VectorRegister4Float Row2 = VectorLoad(SocketToCloth.M[2]);
+		const VectorRegister4Float Row3 = VectorLoad(SocketToCloth.M[3]);
+
+		// XPBD step: the correction is measured against the position integration is about to produce and becomes the
+		// velocity that lands there, so soft pins are damped instead of ringing around the socket. With zero compliance
+		// the weight is one, a hard pin lands exactly on its socket and carries the socket velocity for spring damping.
+		const float Weight = 1.f / (1.f + Binding.Compliance / FMath::Square(DeltaTime));
+		const VectorRegister4Float Dt = VectorSetFloat1(DeltaTime);
+		const VectorRegister4Float VelocityScale = VectorSetFloat1(Weight / DeltaTime);
+
+		for (int32 I = Binding.First; I < Binding.First + Binding.Num; ++I)
+		{
+			FClothMeshVertex& Vertex = VertexBuffer[Particles[I]];
+			const FVector3f& Offset = Offsets[I];
+
+			const VectorRegister4Float Goal = VectorMultiplyAdd(VectorSetFloat1(Offset.X), Row0,
+				VectorMultiplyAdd(VectorSetFloat1(Offset.Y), Row1,
+				VectorMultiplyAdd(VectorSetFloat1(Offset.Z), Row2, Row3)));
+			const VectorRegister4Float Position = VectorLoadFloat3_W0(&Vertex.Position.X);
+			const VectorRegister4Float Velocity = VectorLoadFloat3_W0(&Vertex.Velocity.X);
+			const VectorRegister4Float Delta = VectorSubtract(Goal, VectorMultiplyAdd(Velocity, Dt, Position));
+
+			VectorStoreFloat3(VectorMultiplyAdd(Delta, VelocityScale, Velocity), &Vertex.Velocity.X);
+		}
+	}
+}
+
+FTransform FClothPinning::GetSocketToCloth(const FBinding& Binding, const USceneComponent* Target, const FTransform& ClothToWorld, const TArray<FTransform>* BoneTransforms) const
+{
+	FTransform SocketToTarget = FTransform::Identity;
+	if (nullptr != BoneTransforms && BoneTransforms->IsValidIndex(Binding.BoneIndex))
+	{
+		SocketToTarget = Binding.SocketToBone * (*BoneTransforms)[Binding.BoneIndex];
+	}
+	else if (Binding.SocketName != NAME_None)
+	{
+		SocketToTarget = Target->GetSocketTransform(Binding.SocketName, RTS_Component);
+	}
+
+	return (SocketToTarget * Target->GetComponentTransform()).GetRelativeTransform(ClothToWorld);
+}
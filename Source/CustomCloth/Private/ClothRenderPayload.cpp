@@ -0,0 +1,55 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ClothRenderPayload.h"
+
+#include "ClothMeshComponent.h"
+
+void FClothMeshRenderPayload::CopyFrom(const FClothMeshData& ClothMesh, const bool bWithTopology, const FVector3f& Offset)
+{
+	const TArray<FClothMeshVertex>& VertexBuffer = ClothMesh.VertexBuffer;
+	const int32 NumVerts = VertexBuffer.Num();
+
+	Positions.SetNumUninitialized(NumVerts, false);
+	for (int32 Idx = 0; Idx < NumVerts; ++Idx)
+	{
+		Positions[Idx] = VertexBuffer[Idx].Position + Offset;
+	}
+
+	bTopologyDirty = bWithTopology;
+	if (bWithTopology)
+	{
+		Colors.SetNumUninitialized(NumVerts, false);
+		for (int32 Idx = 0; Idx < NumVerts; ++Idx)
+		{
+			Colors[Idx] = VertexBuffer[Idx].Color;
+		}
+		Indices.Reset();
+		Indices.Append(ClothMesh.IndexBuffer);
+	}
+}
+
+FClothRenderPayloadPool::~FClothRenderPayloadPool()
+{
+	while (FClothMeshRenderPayload* Payload = FreePayloads.Pop())
+	{
+		delete Payload;
+	}
+}
+
+FClothMeshRenderPayload* FClothRenderPayloadPool::Acquire()
+{
+	if (FClothMeshRenderPayload* Payload = FreePayloads.Pop())
+	{
+		return Payload;
+	}
+
+	NumAllocated.fetch_add(1, std::memory_order_relaxed);
+	return new FClothMeshRenderPayload;
+}
+
+void FClothRenderPayloadPool::Release(FClothMeshRenderPayload* Payload)
+{
+	check(Payload);
+	FreePayloads.Push(Payload);
+}
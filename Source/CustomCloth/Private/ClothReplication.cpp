@@ -0,0 +1,292 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ClothReplication.h"
+
+#include "ClothMeshComponent.h"
+
+#pragma region Byte Stream
+
+static void WriteBytes(TArray<uint8>& Data, const void* Src, const int32 Size)
+{
+	Data.Append(static_cast<const uint8*>(Src), Size);
+}
+
+static bool ReadBytes(const TArray<uint8>& Data, int32& Cursor, void* Dst, const int32 Size)
+{
+	if (Cursor + Size > Data.Num())
+	{
+		return false;
+	}
+	FMemory::Memcpy(Dst, Data.GetData() + Cursor, Size);
+	Cursor += Size;
+	return true;
+}
+
+static void WriteVarint(TArray<uint8>& Data, const int32 Value)
+{
+	// Zig-zag so that small negative deltas stay small.
+	uint32 Bits = (static_cast<uint32>(Value) << 1) ^ static_cast<uint32>(Value >> 31);
+	while (Bits >= 0x80)
+	{
+		Data.Add(static_cast<uint8>(Bits | 0x80));
+		Bits >>= 7;
+	}
+	Data.Add(static_cast<uint8>(Bits));
+}
+
+static bool ReadVarint(const TArray<uint8>& Data, int32& Cursor, int32& OutValue)
+{
+	uint32 Bits = 0;
+	for (int32 Shift = 0; Shift < 35; Shift += 7)
+	{
+		if (Cursor >= Data.Num())
+		{
+			return false;
+		}
+		const uint8 Byte = Data[Cursor++];
+		Bits |= static_cast<uint32>(Byte & 0x7F) << Shift;
+		if ((Byte & 0x80) == 0)
+		{
+			OutValue = static_cast<int32>(Bits >> 1) ^ -static_cast<int32>(Bits & 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+#pragma endregion Byte Stream
+
+#pragma region Codec
+
+bool FClothStateCodec::Quantize(const FClothMeshVertex& Vertex, uint16* Out) const
+{
+	bool bInRange = true;
+	auto Encode = [&bInRange](const float Fraction)
+	{
+		bInRange &= Fraction >= 0.f && Fraction <= 1.f;
+		return static_cast<uint16>(FMath::RoundToInt(FMath::Clamp(Fraction, 0.f, 1.f) * 65535.f));
+	};
+
+	const FVector3f Position = (Vertex.Position - Space.BoxMin) / Space.BoxSize;
+	const FVector3f Velocity = Vertex.Velocity / Space.VelocityRange * 0.5f + FVector3f(0.5f);
+	Out[0] = Encode(Position.X);
+	Out[1] = Encode(Position.Y);
+	Out[2] = Encode(Position.Z);
+	Out[3] = Encode(Velocity.X);
+	Out[4] = Encode(Velocity.Y);
+	Out[5] = Encode(Velocity.Z);
+	return bInRange;
+}
+
+void FClothStateCodec::Dequantize(const uint16* In, FClothMeshVertex& Vertex) const
+{
+	constexpr float Scale = 1.f / 65535.f;
+	const FVector3f Position = Space.BoxMin + FVector3f(In[0], In[1], In[2]) * Scale * Space.BoxSize;
+	const FVector3f Velocity = (FVector3f(In[3], In[4], In[5]) * Scale - FVector3f(0.5f)) * 2.f * Space.VelocityRange;
+	Vertex.Position = Position;
+	Vertex.Velocity = Velocity;
+}
+
+void FClothStateCodec::BeginKeyframe(const FClothMeshData& Mesh, const FBox& Bounds, const FVector& Origin, const uint32 Frame)
+{
+	const TArray<FClothMeshVertex>& VertexBuffer = Mesh.VertexBuffer;
+	const int32 NumParticles = VertexBuffer.Num();
+
+	Space.Origin = Origin;
+	Space.BoxMin = FVector3f(Bounds.Min);
+	Space.BoxSize = FVector3f(Bounds.GetSize()).ComponentMax(FVector3f(KINDA_SMALL_NUMBER));
+
+	// Twice the fastest component leaves headroom for the deltas that follow.
+	float MaxSpeed = KINDA_SMALL_NUMBER;
+	for (const FClothMeshVertex& Vertex : VertexBuffer)
+	{
+		MaxSpeed = FMath::Max(MaxSpeed, Vertex.Velocity.GetAbsMax());
+	}
+	Space.VelocityRange = MaxSpeed * 2.f;
+
+	Keyframe.SetNumUninitialized(NumParticles * ComponentsPerParticle, false);
+	for (int32 P = 0; P < NumParticles; ++P)
+	{
+		Quantize(VertexBuffer[P], Keyframe.GetData() + P * ComponentsPerParticle);
+	}
+	KeyframeFrame = Frame;
+	bHasKeyframe = true;
+
+	SendCursor = 0;
+	bSendingKeyframe = true;
+}
+
+void FClothStateCodec::EncodeKeyframeChunk(const int32 MaxBytes, FClothStatePacket& Out)
+{
+	check(bSendingKeyframe);
+
+	constexpr int32 ParticleBytes = ComponentsPerParticle * sizeof(uint16);
+	const int32 NumParticles = Keyframe.Num() / ComponentsPerParticle;
+	const int32 First = SendCursor;
+	const int32 Count = FMath::Min(FMath::Max(MaxBytes / ParticleBytes, 1), NumParticles - First);
+
+	// Every chunk carries the whole header, the client may join in on any keyframe.
+	Out.Frame = KeyframeFrame;
+	Out.BaseFrame = KeyframeFrame;
+	Out.Data.Reset();
+	WriteBytes(Out.Data, &Space.Origin, sizeof(Space.Origin));
+	WriteBytes(Out.Data, &Space.BoxMin, sizeof(Space.BoxMin));
+	WriteBytes(Out.Data, &Space.BoxSize, sizeof(Space.BoxSize));
+	WriteBytes(Out.Data, &Space.VelocityRange, sizeof(Space.VelocityRange));
+	WriteBytes(Out.Data, &NumParticles, sizeof(NumParticles));
+	WriteBytes(Out.Data, &First, sizeof(First));
+	WriteBytes(Out.Data, &Count, sizeof(Count));
+	WriteBytes(Out.Data, Keyframe.GetData() + First * ComponentsPerParticle, Count * ParticleBytes);
+
+	SendCursor = First + Count;
+	if (SendCursor >= NumParticles)
+	{
+		SendCursor = 0;
+		bSendingKeyframe = false;
+	}
+}
+
+bool FClothStateCodec::EncodeDelta(const FClothMeshData& Mesh, const uint32 Frame, const int32 MaxBytes, FClothStatePacket& Out)
+{
+	const TArray<FClothMeshVertex>& VertexBuffer = Mesh.VertexBuffer;
+	const int32 NumParticles = VertexBuffer.Num();
+	if (!bHasKeyframe || bSendingKeyframe || Keyframe.Num() != NumParticles * ComponentsPerParticle)
+	{
+		return false;
+	}
+
+	const int32 First = SendCursor < NumParticles ? SendCursor : 0;
+
+	Out.Frame = Frame;
+	Out.BaseFrame = KeyframeFrame;
+	Out.Data.Reset();
+	WriteBytes(Out.Data, &First, sizeof(First));
+
+	// Count is patched in once the chunk is full.
+	const int32 CountOffset = Out.Data.AddZeroed(sizeof(int32));
+
+	int32 P = First;
+	uint16 Quantized[ComponentsPerParticle];
+	while (P < NumParticles && (P == First || Out.Data.Num() < MaxBytes))
+	{
+		if (!Quantize(VertexBuffer[P], Quantized))
+		{
+			return false;
+		}
+
+		const uint16* Base = Keyframe.GetData() + P * ComponentsPerParticle;
+		for (int32 C = 0; C < ComponentsPerParticle; ++C)
+		{
+			WriteVarint(Out.Data, static_cast<int32>(Quantized[C]) - static_cast<int32>(Base[C]));
+		}
+		++P;
+	}
+
+	const int32 Count = P - First;
+	FMemory::Memcpy(Out.Data.GetData() + CountOffset, &Count, sizeof(Count));
+	SendCursor = P;
+	return true;
+}
+
+bool FClothStateCodec::DecodeKeyframe(const FClothStatePacket& Packet, FClothMeshData& Mesh)
+{
+	int32 Cursor = 0;
+	int32 NumParticles = 0, First = 0, Count = 0;
+	FQuantizationSpace NewSpace;
+	if (!ReadBytes(Packet.Data, Cursor, &NewSpace.Origin, sizeof(NewSpace.Origin))
+		|| !ReadBytes(Packet.Data, Cursor, &NewSpace.BoxMin, sizeof(NewSpace.BoxMin))
+		|| !ReadBytes(Packet.Data, Cursor, &NewSpace.BoxSize, sizeof(NewSpace.BoxSize))
+		|| !ReadBytes(Packet.Data, Cursor, &NewSpace.VelocityRange, sizeof(NewSpace.VelocityRange))
+		|| !ReadBytes(Packet.Data, Cursor, &NumParticles, sizeof(NumParticles))
+		|| !ReadBytes(Packet.Data, Cursor, &First, sizeof(First))
+		|| !ReadBytes(Packet.Data, Cursor, &Count, sizeof(Count))
+		|| NumParticles != Mesh.VertexBuffer.Num()
+		|| First < 0 || Count < 0 || Count > NumParticles - First)
+	{
+		return false;
+	}
+
+	// Chunks arrive in order. A gap means one was lost, the rest of that keyframe is ignored until the next one starts.
+	if (First == 0)
+	{
+		IncomingSpace = NewSpace;
+		IncomingFrame = Packet.Frame;
+		IncomingKeyframe.SetNumUninitialized(NumParticles * ComponentsPerParticle, false);
+		IncomingCursor = 0;
+	}
+	else if (First != IncomingCursor || Packet.Frame != IncomingFrame || IncomingKeyframe.Num() != NumParticles * ComponentsPerParticle)
+	{
+		IncomingCursor = INDEX_NONE;
+		return false;
+	}
+
+	if (!ReadBytes(Packet.Data, Cursor, IncomingKeyframe.GetData() + First * ComponentsPerParticle, Count * ComponentsPerParticle * sizeof(uint16)))
+	{
+		IncomingCursor = INDEX_NONE;
+		return false;
+	}
+
+	IncomingCursor = First + Count;
+	if (IncomingCursor < NumParticles)
+	{
+		return false;
+	}
+
+	Space = IncomingSpace;
+	Swap(Keyframe, IncomingKeyframe);
+	KeyframeFrame = IncomingFrame;
+	bHasKeyframe = true;
+	IncomingCursor = INDEX_NONE;
+
+	for (int32 P = 0; P < NumParticles; ++P)
+	{
+		Dequantize(Keyframe.GetData() + P * ComponentsPerParticle, Mesh.VertexBuffer[P]);
+	}
+	return true;
+}
+
+bool FClothStateCodec::DecodeDelta(const FClothStatePacket& Packet, FClothMeshData& Mesh) const
+{
+	const int32 NumParticles = Mesh.VertexBuffer.Num();
+	if (!bHasKeyframe || Packet.BaseFrame != KeyframeFrame || Keyframe.Num() != NumParticles * ComponentsPerParticle)
+	{
+		return false;
+	}
+
+	int32 Cursor = 0;
+	int32 First = 0, Count = 0;
+	if (!ReadBytes(Packet.Data, Cursor, &First, sizeof(First))
+		|| !ReadBytes(Packet.Data, Cursor, &Count, sizeof(Count))
+		|| First < 0 || Count < 0 || Count > NumParticles - First)
+	{
+		return false;
+	}
+
+	// Decode everything before touching the mesh so a truncated packet leaves it as it was.
+	const int32 DataStart = Cursor;
+	int32 Delta = 0;
+	for (int32 I = 0; I < Count * ComponentsPerParticle; ++I)
+	{
+		if (!ReadVarint(Packet.Data, Cursor, Delta))
+		{
+			return false;
+		}
+	}
+
+	Cursor = DataStart;
+	uint16 Quantized[ComponentsPerParticle];
+	for (int32 P = First; P < First + Count; ++P)
+	{
+		const uint16* Base = Keyframe.GetData() + P * ComponentsPerParticle;
+		for (int32 C = 0; C < ComponentsPerParticle; ++C)
+		{
+			ReadVarint(Packet.Data, Cursor, Delta);
+			Quantized[C] = static_cast<uint16>(FMath::Clamp(Base[C] + Delta, 0, 65535));
+		}
+		Dequantize(Quantized, Mesh.VertexBuffer[P]);
+	}
+	return true;
+}
+
+#pragma endregion Codec
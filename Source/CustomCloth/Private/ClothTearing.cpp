@@ -0,0 +1,225 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ClothTearing.h"
+
+#include "ClothMeshComponent.h"
+
+#pragma region Adjacency
+
+void FClothVertexAdjacency::Init(const int32 NumVertices, const int32 VertexCapacity, const int32 InStride)
+{
+	Stride = InStride;
+	Slots.SetNumUninitialized(VertexCapacity * Stride);
+	Counts.SetNumZeroed(VertexCapacity);
+	check(NumVertices <= VertexCapacity);
+}
+
+void FClothVertexAdjacency::Add(const int32 Vertex, const int32 Element)
+{
+	check(Counts[Vertex] < Stride);
+	Slots[Vertex * Stride + Counts[Vertex]++] = Element;
+}
+
+void FClothVertexAdjacency::Remove(const int32 Vertex, const int32 Element)
+{
+	TArrayView<int32> List = Get(Vertex);
+	const int32 Found = List.Find(Element);
+	if (INDEX_NONE != Found)
+	{
+		List[Found] = List.Last();
+		--Counts[Vertex];
+	}
+}
+
+void FClothVertexAdjacency::Replace(const int32 Vertex, const int32 OldElement, const int32 NewElement)
+{
+	TArrayView<int32> List = Get(Vertex);
+	if (const int32 Found = List.Find(OldElement); INDEX_NONE != Found)
+	{
+		List[Found] = NewElement;
+	}
+}
+
+#pragma endregion Adjacency
+
+#pragma region Tearing
+
+void FClothTearing::Build(FClothMeshData& Mesh, TArray<FClothMassString>& Springs, const int32 TearCapacity)
+{
+	auto& [VertexBuffer, IndexBuffer] = Mesh;
+	const int32 NumVerts = VertexBuffer.Num();
+	VertexCapacity = NumVerts + FMath::Max(TearCapacity, 0);
+
+	// Springs point into the vertex buffer, remember them as indices across the reserve.
+	TArray<TPair<int32, int32>> Endpoints;
+	Endpoints.Reserve(Springs.Num());
+	for (const FClothMassString& Spring : Springs)
+	{
+		Endpoints.Add({ static_cast<int32>(Spring.VertexA - VertexBuffer.GetData()), static_cast<int32>(Spring.VertexB - VertexBuffer.GetData()) });
+	}
+
+	VertexBuffer.Reserve(VertexCapacity);
+	for (int32 S = 0; S < Springs.Num(); ++S)
+	{
+		Springs[S].VertexA = &VertexBuffer[Endpoints[S].Key];
+		Springs[S].VertexB = &VertexBuffer[Endpoints[S].Value];
+	}
+
+	TArray<int32> TriangleValence, SpringValence;
+	TriangleValence.SetNumZeroed(NumVerts);
+	SpringValence.SetNumZeroed(NumVerts);
+	for (const uint32 Index : IndexBuffer)
+	{
+		++TriangleValence[Index];
+	}
+	for (const auto& [A, B] : Endpoints)
+	{
+		++SpringValence[A];
+		++SpringValence[B];
+	}
+
+	VertexTriangles.Init(NumVerts, VertexCapacity, FMath::Max(1, FMath::Max(TriangleValence)));
+	VertexSprings.Init(NumVerts, VertexCapacity, FMath::Max(1, FMath::Max(SpringValence)));
+
+	for (int32 I = 0; I < IndexBuffer.Num(); ++I)
+	{
+		VertexTriangles.Add(IndexBuffer[I], I / 3);
+	}
+	for (int32 S = 0; S < Endpoints.Num(); ++S)
+	{
+		VertexSprings.Add(Endpoints[S].Key, S);
+		VertexSprings.Add(Endpoints[S].Value, S);
+	}
+}
+
+int32 FClothTearing::Step(FClothMeshData& Mesh, TArray<FClothMassString>& Springs, const float BreakRatio, const int32 MaxTears)
+{
+	const FClothMeshVertex* Base = Mesh.VertexBuffer.GetData();
+	const float BreakRatioSq = FMath::Square(BreakRatio);
+
+	int32 NumTears = 0;
+
+	// Walk backwards so the spring swapped into a removed slot has already been tested.
+	for (int32 S = Springs.Num() - 1; S >= 0 && NumTears < MaxTears; --S)
+	{
+		const FClothMassString& Spring = Springs[S];
+		const float LengthSq = FVector3f::DistSquared(Spring.VertexA->Position, Spring.VertexB->Position);
+		if (LengthSq <= BreakRatioSq * FMath::Square(Spring.RestLength))
+		{
+			continue;
+		}
+
+		const int32 A = static_cast<int32>(Spring.VertexA - Base);
+		const int32 B = static_cast<int32>(Spring.VertexB - Base);
+		RemoveSpring(Springs, S, Base);
+
+		// Pinned particles are never split, a duplicate would not be driven by its pin and hang in place forever.
+		// The crack goes through the free end instead, between two pins the spring just breaks.
+		if (!Base[A].bDisablePhys)
+		{
+			SplitVertex(Mesh, Springs, A, B);
+		}
+		else if (!Base[B].bDisablePhys)
+		{
+			SplitVertex(Mesh, Springs, B, A);
+		}
+		++NumTears;
+	}
+
+	return NumTears;
+}
+
+void FClothTearing::RemoveSpring(TArray<FClothMassString>& Springs, const int32 SpringIndex, const FClothMeshVertex* Base)
+{
+	const FClothMassString& Removed = Springs[SpringIndex];
+	VertexSprings.Remove(static_cast<int32>(Removed.VertexA - Base), SpringIndex);
+	VertexSprings.Remove(static_cast<int32>(Removed.VertexB - Base), SpringIndex);
+
+	if (const int32 Last = Springs.Num() - 1; SpringIndex != Last)
+	{
+		const FClothMassString& Moved = Springs[Last];
+		VertexSprings.Replace(static_cast<int32>(Moved.VertexA - Base), Last, SpringIndex);
+		VertexSprings.Replace(static_cast<int32>(Moved.VertexB - Base), Last, SpringIndex);
+	}
+
+	Springs.RemoveAtSwap(SpringIndex, 1, false);
+}
+
+void FClothTearing::SplitVertex(FClothMeshData& Mesh, TArray<FClothMassString>& Springs, const int32 Vertex, const int32 Other)
+{
+	auto& [VertexBuffer, IndexBuffer] = Mesh;
+
+	// Out of spare particles, the spring stays broken but the surface is not cut. The buffer itself may have more
+	// slack than the adjacency, so the limit is the capacity from Build.
+	if (VertexBuffer.Num() >= VertexCapacity)
+	{
+		return;
+	}
+
+	// The crack runs through Vertex, perpendicular to the broken spring. Everything on the far side of it moves over
+	// to the duplicate.
+	const FVector3f Origin = VertexBuffer[Vertex].Position;
+	const FVector3f Dir = VertexBuffer[Other].Position - Origin;
+	auto IsFarSide = [&Origin, &Dir](const FVector3f& Position) { return FVector3f::DotProduct(Position - Origin, Dir) < 0.f; };
+
+	auto TriangleCentroid = [&VertexBuffer, &IndexBuffer](const int32 Tri)
+	{
+		return (VertexBuffer[IndexBuffer[Tri * 3]].Position + VertexBuffer[IndexBuffer[Tri * 3 + 1]].Position + VertexBuffer[IndexBuffer[Tri * 3 + 2]].Position) / 3.f;
+	};
+
+	int32 NumFar = 0;
+	const TArrayView<int32> Triangles = VertexTriangles.Get(Vertex);
+	for (const int32 Tri : Triangles)
+	{
+		NumFar += IsFarSide(TriangleCentroid(Tri)) ? 1 : 0;
+	}
+	if (NumFar == 0 || NumFar == Triangles.Num())
+	{
+		return;
+	}
+
+	const FClothMeshVertex* Base = VertexBuffer.GetData();
+	const FClothMeshVertex Copy = VertexBuffer[Vertex];
+	const int32 Duplicate = VertexBuffer.Add(Copy);
+	check(VertexBuffer.GetData() == Base);
+
+	for (int32 Slot = VertexTriangles.Get(Vertex).Num() - 1; Slot >= 0; --Slot)
+	{
+		const int32 Tri = VertexTriangles.Get(Vertex)[Slot];
+		if (!IsFarSide(TriangleCentroid(Tri)))
+		{
+			continue;
+		}
+
+		for (int32 Corner = 0; Corner < 3; ++Corner)
+		{
+			if (IndexBuffer[Tri * 3 + Corner] == static_cast<uint32>(Vertex))
+			{
+				IndexBuffer[Tri * 3 + Corner] = Duplicate;
+			}
+		}
+		VertexTriangles.Remove(Vertex, Tri);
+		VertexTriangles.Add(Duplicate, Tri);
+	}
+
+	FClothMeshVertex* const Original = &VertexBuffer[Vertex];
+	FClothMeshVertex* const Split = &VertexBuffer[Duplicate];
+	for (int32 Slot = VertexSprings.Get(Vertex).Num() - 1; Slot >= 0; --Slot)
+	{
+		const int32 S = VertexSprings.Get(Vertex)[Slot];
+		FClothMassString& Spring = Springs[S];
+		FClothMeshVertex*& Endpoint = Spring.VertexA == Original ? Spring.VertexA : Spring.VertexB;
+		const FClothMeshVertex* Opposite = Spring.VertexA == Original ? Spring.VertexB : Spring.VertexA;
+		if (!IsFarSide(Opposite->Position))
+		{
+			continue;
+		}
+
+		Endpoint = Split;
+		VertexSprings.Remove(Vertex, S);
+		VertexSprings.Add(Duplicate, S);
+	}
+}
+
+#pragma endregion Tearing
@@ -0,0 +1,104 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ClothTestWorld.h"
+#include "HAL/MemoryBase.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+/**
+ * Forwards to the allocator it replaces and counts the allocations made on the game and the render thread.
+ * Worker threads are left out, the engine runs unrelated background work there.
+ */
+class FClothCountingMalloc final : public FMalloc
+{
+public:
+	explicit FClothCountingMalloc(FMalloc* InInner)
+		: Inner(InInner)
+	{
+	}
+
+	virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+	{
+		CountAllocation(Count);
+		return Inner->Malloc(Count, Alignment);
+	}
+
+	virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+	{
+		CountAllocation(Count);
+		return Inner->Realloc(Original, Count, Alignment);
+	}
+
+	virtual void Free(void* Original) override
+	{
+		Inner->Free(Original);
+	}
+
+	virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override
+	{
+		return Inner->QuantizeSize(Count, Alignment);
+	}
+
+	virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override
+	{
+		return Inner->GetAllocationSize(Original, SizeOut);
+	}
+
+	virtual bool IsInternallyThreadSafe() const override
+	{
+		return Inner->IsInternallyThreadSafe();
+	}
+
+	virtual const TCHAR* GetDescriptiveName() override
+	{
+		return TEXT("ClothCountingMalloc");
+	}
+
+	FORCEINLINE FMalloc* GetInner() const { return Inner; }
+	FORCEINLINE int32 GetNumAllocations() const { return NumAllocations.load(std::memory_order_relaxed); }
+
+private:
+	FORCEINLINE void CountAllocation(const SIZE_T Size)
+	{
+		if (Size > 0 && (IsInGameThread() || IsInActualRenderingThread()))
+		{
+			NumAllocations.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	FMalloc* Inner;
+	std::atomic<int32> NumAllocations { 0 };
+};
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FClothSteadyStateAllocationTest, "CustomCloth.Allocation.SteadyState", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FClothSteadyStateAllocationTest::RunTest(const FString& Parameters)
+{
+	// The render thread is allowed to lag this many frames, as it would in a running game.
+	constexpr int32 RenderLag = 3;
+
+	FClothTestWorld TestWorld;
+	UClothMeshComponent* Cloth = TestWorld.AddCloth([](UClothMeshComponent& Config)
+	{
+		Config.bEnableAerodynamics = true;
+	});
+
+	// Warm up, the pool and the arena size themselves during the first frames.
+	FClothTestWorld::Tick(Cloth, 8 * RenderLag, 1.0f / 60.0f, RenderLag);
+	const int32 NumPayloads = Cloth->GetNumPayloadsAllocated();
+	const uint32 NumGrows = Cloth->GetNumFrameArenaGrows();
+
+	FClothCountingMalloc CountingMalloc(GMalloc);
+	GMalloc = &CountingMalloc;
+	FClothTestWorld::Tick(Cloth, 40 * RenderLag, 1.0f / 60.0f, RenderLag);
+	GMalloc = CountingMalloc.GetInner();
+
+	TestEqual(TEXT("Allocations after warm up"), CountingMalloc.GetNumAllocations(), 0);
+	TestEqual(TEXT("Payloads allocated after warm up"), Cloth->GetNumPayloadsAllocated(), NumPayloads);
+	TestEqual(TEXT("Frame arena grows after warm up"), Cloth->GetNumFrameArenaGrows(), NumGrows);
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,197 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ClothMeshBuilder.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+/** NumX by NumY quads in the XY plane, both triangles of a quad share the diagonal from its first corner. */
+static FClothMeshData MakeQuadGrid(const int32 NumX, const int32 NumY, const float Spacing)
+{
+	FClothMeshData Mesh;
+	for (int32 Y = 0; Y <= NumY; ++Y)
+	{
+		for (int32 X = 0; X <= NumX; ++X)
+		{
+			Mesh.VertexBuffer.Add(FClothMeshVertex { FVector3f(X * Spacing, Y * Spacing, 0.f) });
+		}
+	}
+
+	for (int32 Y = 0; Y < NumY; ++Y)
+	{
+		for (int32 X = 0; X < NumX; ++X)
+		{
+			const uint32 V00 = Y * (NumX + 1) + X;
+			const uint32 V10 = V00 + 1;
+			const uint32 V01 = V00 + NumX + 1;
+			const uint32 V11 = V01 + 1;
+			Mesh.IndexBuffer.Append({ V00, V10, V11, V00, V11, V01 });
+		}
+	}
+	return Mesh;
+}
+
+/** Triangles with their corners in order, sorted, so two index buffers can be compared as sets. */
+static TArray<FIntVector> GetSortedTriangles(const TArray<uint32>& Indices)
+{
+	TArray<FIntVector> Triangles;
+	for (int32 I = 0; I + 2 < Indices.Num(); I += 3)
+	{
+		Triangles.Emplace(Indices[I], Indices[I + 1], Indices[I + 2]);
+	}
+	Triangles.Sort([](const FIntVector& L, const FIntVector& R)
+	{
+		return L.X != R.X ? L.X < R.X : L.Y != R.Y ? L.Y < R.Y : L.Z < R.Z;
+	});
+	return Triangles;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FClothMeshBuilderWeldTest, "CustomCloth.MeshBuilder.WeldVertices", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FClothMeshBuilderWeldTest::RunTest(const FString& Parameters)
+{
+	// Two quads with their own vertices, split along the shared edge like a UV seam.
+	FClothMeshData Mesh;
+	const FVector3f Corners[] = {
+		{ 0.f, 0.f, 0.f }, { 10.f, 0.f, 0.f }, { 10.f, 10.f, 0.f }, { 0.f, 10.f, 0.f },
+		{ 10.f, 0.f, 0.f }, { 20.f, 0.f, 0.f }, { 20.f, 10.f, 0.f }, { 10.f, 10.f, 0.001f },
+	};
+	for (const FVector3f& Corner : Corners)
+	{
+		Mesh.VertexBuffer.Add(FClothMeshVertex { Corner });
+	}
+	Mesh.VertexBuffer[4].bDisablePhys = true;
+	Mesh.IndexBuffer = { 0, 1, 2, 0, 2, 3, 4, 5, 6, 4, 6, 7 };
+
+	// Collapses onto one edge once the seam is welded.
+	Mesh.IndexBuffer.Append({ 1, 2, 4 });
+
+	FClothMeshBuilder::WeldVertices(Mesh, 0.01f);
+
+	TestEqual(TEXT("Particles"), Mesh.VertexBuffer.Num(), 6);
+	TestEqual(TEXT("Indices"), Mesh.IndexBuffer.Num(), 12);
+	for (const uint32 Index : Mesh.IndexBuffer)
+	{
+		if (!TestTrue(TEXT("Index in range"), Index < static_cast<uint32>(Mesh.VertexBuffer.Num())))
+		{
+			return true;
+		}
+	}
+
+	// The seam vertices are shared by both quads and keep the pin of either duplicate.
+	const uint32 SeamBottom = Mesh.IndexBuffer[1];
+	TestEqual(TEXT("Bottom seam vertex is shared"), Mesh.IndexBuffer[6], SeamBottom);
+	TestEqual(TEXT("Top seam vertex is shared"), Mesh.IndexBuffer[11], Mesh.IndexBuffer[2]);
+	TestTrue(TEXT("Welded vertex keeps the pin"), Mesh.VertexBuffer[SeamBottom].bDisablePhys);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FClothMeshBuilderSpringsTest, "CustomCloth.MeshBuilder.BuildSprings", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FClothMeshBuilderSpringsTest::RunTest(const FString& Parameters)
+{
+	constexpr float Spacing = 10.f;
+	const FClothMeshData Mesh = MakeQuadGrid(2, 2, Spacing);
+
+	TArray<FClothSpringDesc> Springs;
+	FClothMeshBuilder::BuildSprings(Mesh, Springs);
+
+	// 12 grid edges, both diagonals of the 4 quads, and one bending spring across each of the 4 interior edges.
+	int32 NumByType[3] = { 0, 0, 0 };
+	for (const FClothSpringDesc& Spring : Springs)
+	{
+		++NumByType[static_cast<int32>(Spring.Type)];
+
+		float ExpectedLength = Spacing;
+		if (Spring.Type == ESpringType::Shear)
+		{
+			ExpectedLength = Spacing * FMath::Sqrt(2.f);
+		}
+		else if (Spring.Type == ESpringType::Bending)
+		{
+			ExpectedLength = Spacing * FMath::Sqrt(5.f);
+		}
+		if (!TestEqual(TEXT("Rest length"), Spring.RestLength, ExpectedLength, KINDA_SMALL_NUMBER * Spacing))
+		{
+			return true;
+		}
+	}
+
+	TestEqual(TEXT("Springs"), Springs.Num(), 24);
+	TestEqual(TEXT("Structural springs"), NumByType[static_cast<int32>(ESpringType::Structural)], 12);
+	TestEqual(TEXT("Shear springs"), NumByType[static_cast<int32>(ESpringType::Shear)], 8);
+	TestEqual(TEXT("Bending springs"), NumByType[static_cast<int32>(ESpringType::Bending)], 4);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FClothMeshBuilderMortonTest, "CustomCloth.MeshBuilder.ReorderParticlesMorton", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FClothMeshBuilderMortonTest::RunTest(const FString& Parameters)
+{
+	FClothMeshData Mesh = MakeQuadGrid(12, 9, 10.f);
+	FRandomStream Random(0x3047);
+	for (FClothMeshVertex& Vertex : Mesh.VertexBuffer)
+	{
+		Vertex.Position.Z = Random.FRandRange(-5.f, 5.f);
+	}
+	const FClothMeshData Original = Mesh;
+
+	FClothMeshBuilder::ReorderParticlesMorton(Mesh);
+
+	// Grid positions are unique, so matching positions means every corner still refers to the same particle.
+	TestEqual(TEXT("Particles"), Mesh.VertexBuffer.Num(), Original.VertexBuffer.Num());
+	TestEqual(TEXT("Indices"), Mesh.IndexBuffer.Num(), Original.IndexBuffer.Num());
+	TestNotEqual(TEXT("Particles were reordered"), Mesh.IndexBuffer, Original.IndexBuffer);
+	for (int32 I = 0; I < Original.IndexBuffer.Num(); ++I)
+	{
+		const FVector3f& Expected = Original.VertexBuffer[Original.IndexBuffer[I]].Position;
+		const FVector3f& Actual = Mesh.VertexBuffer[Mesh.IndexBuffer[I]].Position;
+		if (Actual != Expected)
+		{
+			AddError(FString::Printf(TEXT("Corner %d of triangle %d is %s, expected %s"), I % 3, I / 3, *Actual.ToString(), *Expected.ToString()));
+			return true;
+		}
+	}
+
+	TSet<FVector3f> Positions;
+	for (const FClothMeshVertex& Vertex : Mesh.VertexBuffer)
+	{
+		Positions.Add(Vertex.Position);
+	}
+	TestEqual(TEXT("Every particle kept once"), Positions.Num(), Original.VertexBuffer.Num());
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FClothMeshBuilderVertexCacheTest, "CustomCloth.MeshBuilder.OptimizeIndexBufferForVertexCache", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FClothMeshBuilderVertexCacheTest::RunTest(const FString& Parameters)
+{
+	FClothMeshData Mesh = MakeQuadGrid(16, 16, 10.f);
+
+	// Shuffle the triangles so there is something to optimize.
+	FRandomStream Random(0x7195);
+	const int32 NumTris = Mesh.IndexBuffer.Num() / 3;
+	for (int32 Tri = NumTris - 1; Tri > 0; --Tri)
+	{
+		const int32 Other = Random.RandRange(0, Tri);
+		for (int32 Corner = 0; Corner < 3; ++Corner)
+		{
+			Mesh.IndexBuffer.Swap(Tri * 3 + Corner, Other * 3 + Corner);
+		}
+	}
+
+	TArray<uint32> Optimized = Mesh.IndexBuffer;
+	FClothMeshBuilder::OptimizeIndexBufferForVertexCache(Optimized, Mesh.VertexBuffer.Num());
+
+	// Same triangles with the same winding, only their order may change.
+	TestEqual(TEXT("Indices"), Optimized.Num(), Mesh.IndexBuffer.Num());
+	TestTrue(TEXT("Triangles are a permutation of the input"), GetSortedTriangles(Optimized) == GetSortedTriangles(Mesh.IndexBuffer));
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,272 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ClothReplication.h"
+#include "ClothTestWorld.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+static FClothMeshData MakeRandomCloth(const int32 NumParticles, FRandomStream& Random)
+{
+	FClothMeshData Mesh;
+	for (int32 P = 0; P < NumParticles; ++P)
+	{
+		FClothMeshVertex& Vertex = Mesh.VertexBuffer.Add_GetRef(FClothMeshVertex { FVector3f(Random.GetUnitVector() * Random.FRandRange(0.f, 50.f)) });
+		Vertex.Velocity = FVector3f(Random.GetUnitVector() * Random.FRandRange(0.f, 10.f));
+	}
+	return Mesh;
+}
+
+static FBox GetPositionBounds(const FClothMeshData& Mesh)
+{
+	FBox Box(ForceInit);
+	for (const FClothMeshVertex& Vertex : Mesh.VertexBuffer)
+	{
+		Box += FVector(Vertex.Position);
+	}
+	return Box;
+}
+
+/** Send a whole keyframe in chunks of MaxBytes, returns the number of chunks after which the client completed it or INDEX_NONE. */
+static int32 SendKeyframe(FClothStateCodec& Server, FClothStateCodec& Client, FClothMeshData& ClientMesh, const int32 MaxBytes, const int32 DroppedChunk = INDEX_NONE)
+{
+	FClothStatePacket Packet;
+	for (int32 Chunk = 0; Server.IsSendingKeyframe(); ++Chunk)
+	{
+		Server.EncodeKeyframeChunk(MaxBytes, Packet);
+		if (Chunk != DroppedChunk && Client.DecodeKeyframe(Packet, ClientMesh))
+		{
+			return Chunk + 1;
+		}
+	}
+	return INDEX_NONE;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FClothStateCodecRoundTripTest, "CustomCloth.Replication.CodecRoundTrip", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FClothStateCodecRoundTripTest::RunTest(const FString& Parameters)
+{
+	constexpr int32 NumParticles = 1000;
+	constexpr int32 ChunkBytes = 1024;
+
+	FRandomStream Random(0x5eed);
+	FClothMeshData ServerMesh = MakeRandomCloth(NumParticles, Random);
+	FClothMeshData ClientMesh = MakeRandomCloth(NumParticles, Random);
+	const FBox Bounds = GetPositionBounds(ServerMesh).ExpandBy(10.0);
+	const FVector Origin(1.0e6, -2.0e6, 3.0e5);
+
+	FClothStateCodec Server, Client;
+	Server.BeginKeyframe(ServerMesh, Bounds, Origin, 7);
+
+	// 12 bytes per particle, the keyframe has to be split.
+	const int32 NumChunks = SendKeyframe(Server, Client, ClientMesh, ChunkBytes);
+	TestEqual(TEXT("Keyframe chunks"), NumChunks, FMath::DivideAndRoundUp(NumParticles, ChunkBytes / 12));
+	TestTrue(TEXT("Client has the keyframe"), Client.HasKeyframe());
+	TestEqual(TEXT("Keyframe frame"), Client.GetKeyframe(), 7u);
+	TestEqual(TEXT("Keyframe origin"), Client.GetOrigin(), Origin);
+
+	// One quantization step of the bounds, and of the velocity range on both sides of zero.
+	float MaxSpeed = 0.f;
+	for (const FClothMeshVertex& Vertex : ServerMesh.VertexBuffer)
+	{
+		MaxSpeed = FMath::Max(MaxSpeed, Vertex.Velocity.GetAbsMax());
+	}
+	const float PositionTolerance = static_cast<float>(Bounds.GetSize().GetMax()) / 65535.f;
+	const float VelocityTolerance = 4.f * MaxSpeed / 65535.f;
+
+	auto TestMatches = [&](const TCHAR* What)
+	{
+		for (int32 P = 0; P < NumParticles; ++P)
+		{
+			const FClothMeshVertex& Expected = ServerMesh.VertexBuffer[P];
+			const FClothMeshVertex& Actual = ClientMesh.VertexBuffer[P];
+			if (!Expected.Position.Equals(Actual.Position, PositionTolerance) || !Expected.Velocity.Equals(Actual.Velocity, VelocityTolerance))
+			{
+				AddError(FString::Printf(TEXT("%s: particle %d is (%s, %s), expected (%s, %s)"), What, P,
+					*Actual.Position.ToString(), *Actual.Velocity.ToString(), *Expected.Position.ToString(), *Expected.Velocity.ToString()));
+				return;
+			}
+		}
+	};
+	TestMatches(TEXT("Keyframe"));
+
+	// Move every particle a little, the delta covers all of them in one packet.
+	for (FClothMeshVertex& Vertex : ServerMesh.VertexBuffer)
+	{
+		Vertex.Position += FVector3f(Random.GetUnitVector() * 2.0);
+		Vertex.Velocity *= 0.5f;
+	}
+
+	FClothStatePacket Delta;
+	TestTrue(TEXT("Delta fits the keyframe range"), Server.EncodeDelta(ServerMesh, 8, MAX_int32, Delta));
+	TestTrue(TEXT("Delta decodes"), Client.DecodeDelta(Delta, ClientMesh));
+	TestEqual(TEXT("Delta base frame"), Delta.BaseFrame, 7u);
+	TestTrue(TEXT("Delta is smaller than the keyframe"), Delta.Data.Num() < NumParticles * 12);
+	TestMatches(TEXT("Delta"));
+
+	// Leaving the keyframe bounds needs a new keyframe.
+	ServerMesh.VertexBuffer[0].Position += FVector3f(Bounds.GetSize());
+	TestFalse(TEXT("Delta outside the keyframe range"), Server.EncodeDelta(ServerMesh, 9, MAX_int32, Delta));
+
+	// Deltas against a keyframe the client does not hold are dropped.
+	Delta.BaseFrame = 6;
+	TestFalse(TEXT("Delta against another keyframe"), Client.DecodeDelta(Delta, ClientMesh));
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FClothStateCodecLostChunkTest, "CustomCloth.Replication.LostKeyframeChunk", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FClothStateCodecLostChunkTest::RunTest(const FString& Parameters)
+{
+	FRandomStream Random(0xc10f);
+	FClothMeshData ServerMesh = MakeRandomCloth(500, Random);
+	FClothMeshData ClientMesh = MakeRandomCloth(500, Random);
+	const FBox Bounds = GetPositionBounds(ServerMesh);
+
+	FClothStateCodec Server, Client;
+	Server.BeginKeyframe(ServerMesh, Bounds, FVector::ZeroVector, 1);
+	TestEqual(TEXT("Keyframe with a lost chunk"), SendKeyframe(Server, Client, ClientMesh, 1024, 1), static_cast<int32>(INDEX_NONE));
+	TestFalse(TEXT("Client has no keyframe"), Client.HasKeyframe());
+
+	// The next keyframe starts over and completes.
+	Server.BeginKeyframe(ServerMesh, Bounds, FVector::ZeroVector, 2);
+	TestNotEqual(TEXT("Next keyframe"), SendKeyframe(Server, Client, ClientMesh, 1024), static_cast<int32>(INDEX_NONE));
+	TestEqual(TEXT("Keyframe frame"), Client.GetKeyframe(), 2u);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FClothStateLoopbackTest, "CustomCloth.Replication.ClothLoopback", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FClothStateLoopbackTest::RunTest(const FString& Parameters)
+{
+	FClothTestWorld TestWorld;
+	UClothMeshComponent* Cloth = TestWorld.AddCloth([](UClothMeshComponent& Config)
+	{
+		Config.bDeterministic = true;
+		Config.bEnableAerodynamics = true;
+	});
+
+	FRandomStream Random(0x100b);
+	FClothMeshData ClientMesh = MakeRandomCloth(Cloth->ClothMesh.VertexBuffer.Num(), Random);
+	FClothStateCodec Server, Client;
+	float PositionTolerance = 0.f;
+	float VelocityTolerance = 0.f;
+
+	// The server side of PreReplication: deltas while the state fits the keyframe range, a new keyframe otherwise.
+	FClothStatePacket Delta;
+	for (uint32 Frame = 1; Frame <= 120; ++Frame)
+	{
+		FClothTestWorld::Tick(Cloth, 1);
+		const FClothMeshData& ServerMesh = Cloth->ClothMesh;
+
+		if (!Server.HasKeyframe() || !Server.EncodeDelta(ServerMesh, Frame, MAX_int32, Delta))
+		{
+			const FBox Bounds = GetPositionBounds(ServerMesh).ExpandBy(10.0);
+			float MaxSpeed = KINDA_SMALL_NUMBER;
+			for (const FClothMeshVertex& Vertex : ServerMesh.VertexBuffer)
+			{
+				MaxSpeed = FMath::Max(MaxSpeed, Vertex.Velocity.GetAbsMax());
+			}
+			PositionTolerance = static_cast<float>(Bounds.GetSize().GetMax()) / 65535.f;
+			VelocityTolerance = 4.f * MaxSpeed / 65535.f;
+
+			Server.BeginKeyframe(ServerMesh, Bounds, FVector::ZeroVector, Frame);
+			if (!TestNotEqual(TEXT("Keyframe arrives"), SendKeyframe(Server, Client, ClientMesh, 1024), static_cast<int32>(INDEX_NONE)))
+			{
+				return true;
+			}
+		}
+		else if (!TestTrue(TEXT("Delta decodes"), Client.DecodeDelta(Delta, ClientMesh)))
+		{
+			return true;
+		}
+
+		for (int32 P = 0; P < ServerMesh.VertexBuffer.Num(); ++P)
+		{
+			const FClothMeshVertex& Expected = ServerMesh.VertexBuffer[P];
+			const FClothMeshVertex& Actual = ClientMesh.VertexBuffer[P];
+			if (!Expected.Position.Equals(Actual.Position, PositionTolerance) || !Expected.Velocity.Equals(Actual.Velocity, VelocityTolerance))
+			{
+				AddError(FString::Printf(TEXT("Frame %u: particle %d is (%s, %s), expected (%s, %s)"), Frame, P,
+					*Actual.Position.ToString(), *Actual.Velocity.ToString(), *Expected.Position.ToString(), *Expected.Velocity.ToString()));
+				return true;
+			}
+		}
+	}
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FClothDeterministicStepTest, "CustomCloth.Replication.DeterministicSteps", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FClothDeterministicStepTest::RunTest(const FString& Parameters)
+{
+	// Above IntegrationChunkSize particles and MinTrianglesPerTask triangles, so the parallel paths run with several tasks.
+	constexpr int32 Resolution = 48;
+	constexpr float StepTime = 1.0f / 64.0f;
+
+	FClothTestWorld TestWorld;
+	auto Configure = [](UClothMeshComponent& Config)
+	{
+		Config.DestinyX = Resolution;
+		Config.DestinyY = Resolution;
+		Config.bDeterministic = true;
+		Config.FixedTimeStep = StepTime;
+		Config.bEnableAerodynamics = true;
+		Config.bEnableTearing = true;
+		Config.TearBreakRatio = 1.5f;
+	};
+	UClothMeshComponent* ClothA = TestWorld.AddCloth(Configure);
+	UClothMeshComponent* ClothB = TestWorld.AddCloth(Configure);
+	const int32 NumParticles = ClothA->ClothMesh.VertexBuffer.Num();
+	TestTrue(TEXT("Cloth spans several tasks"), NumParticles > 1024 && ClothA->ClothMesh.IndexBuffer.Num() / 3 > 1024);
+
+	// Throw half of both cloths down so the seam between the halves tears.
+	for (UClothMeshComponent* Cloth : { ClothA, ClothB })
+	{
+		TArray<FClothMeshVertex>& Vertices = Cloth->ClothMesh.VertexBuffer;
+		for (int32 P = 0; P < Vertices.Num(); ++P)
+		{
+			if (!Vertices[P].bDisablePhys && P % Resolution < Resolution / 2)
+			{
+				Vertices[P].Velocity.Z -= 500.f;
+			}
+		}
+	}
+
+	// A ticks one step per frame, B alternates zero and two steps. Both sequences are exact in binary, so they add up
+	// to the same steps. Interleaved, so nothing shared between instances can hide behind running them one after the other.
+	for (int32 Frame = 0; Frame < 128; ++Frame)
+	{
+		FClothTestWorld::Tick(ClothA, 2, StepTime);
+		FClothTestWorld::Tick(ClothB, 1, StepTime * 0.5f);
+		FClothTestWorld::Tick(ClothB, 1, StepTime * 1.5f);
+	}
+
+	const TArray<FClothMeshVertex>& VerticesA = ClothA->ClothMesh.VertexBuffer;
+	const TArray<FClothMeshVertex>& VerticesB = ClothB->ClothMesh.VertexBuffer;
+	TestTrue(TEXT("Cloth tore"), VerticesA.Num() > NumParticles);
+	if (!TestEqual(TEXT("Particle count"), VerticesA.Num(), VerticesB.Num()))
+	{
+		return true;
+	}
+	TestEqual(TEXT("Index buffer"), ClothA->ClothMesh.IndexBuffer, ClothB->ClothMesh.IndexBuffer);
+
+	for (int32 P = 0; P < VerticesA.Num(); ++P)
+	{
+		const FClothMeshVertex& A = VerticesA[P];
+		const FClothMeshVertex& B = VerticesB[P];
+		if (FMemory::Memcmp(&A.Position, &B.Position, sizeof(FVector3f)) != 0 || FMemory::Memcmp(&A.Velocity, &B.Velocity, sizeof(FVector3f)) != 0)
+		{
+			AddError(FString::Printf(TEXT("Particle %d differs: (%s, %s) and (%s, %s)"), P,
+				*A.Position.ToString(), *A.Velocity.ToString(), *B.Position.ToString(), *B.Velocity.ToString()));
+			break;
+		}
+	}
+
+	return true;
+}
+
+#endif
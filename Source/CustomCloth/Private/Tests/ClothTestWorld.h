@@ -0,0 +1,75 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "ClothMeshComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "Misc/AutomationTest.h"
+#include "RenderingThread.h"
+
+/** Game world that lives for the scope of one test, cloths are ticked by hand. */
+class FClothTestWorld
+{
+public:
+	FClothTestWorld()
+	{
+		World = UWorld::CreateWorld(EWorldType::Game, false);
+		GEngine->CreateNewWorldContext(EWorldType::Game).SetCurrentWorld(World);
+	}
+
+	~FClothTestWorld()
+	{
+		for (UClothMeshComponent* Cloth : Cloths)
+		{
+			Cloth->UnregisterComponent();
+		}
+		FlushRenderingCommands();
+
+		GEngine->DestroyWorldContext(World);
+		World->DestroyWorld(false);
+	}
+
+	FClothTestWorld(const FClothTestWorld&) = delete;
+	FClothTestWorld& operator=(const FClothTestWorld&) = delete;
+
+	/** Configure runs before registration, so the mesh is built from the final settings. */
+	UClothMeshComponent* AddCloth(TFunctionRef<void(UClothMeshComponent&)> Configure)
+	{
+		UClothMeshComponent* Cloth = NewObject<UClothMeshComponent>(World);
+		Cloth->DestinyX = 16;
+		Cloth->DestinyY = 16;
+		Cloth->ClothSize = FVector2D(100.0, 100.0);
+		Configure(*Cloth);
+		Cloth->RegisterComponentWithWorld(World);
+		Cloths.Add(Cloth);
+		return Cloth;
+	}
+
+	/**
+	 * Render commands are flushed after every FlushInterval ticks, so the render thread lags at most that many frames.
+	 * Payloads are only guaranteed to be back in their pool when NumTicks is a multiple of it.
+	 */
+	static void Tick(UClothMeshComponent* Cloth, const int32 NumTicks, const float DeltaTime = 1.0f / 60.0f, const int32 FlushInterval = 1)
+	{
+		for (int32 Frame = 1; Frame <= NumTicks; ++Frame)
+		{
+			Cloth->TickComponent(DeltaTime, LEVELTICK_All, nullptr);
+			if (Frame % FlushInterval == 0)
+			{
+				FlushRenderingCommands();
+			}
+		}
+	}
+
+	UWorld* World = nullptr;
+
+private:
+	TArray<UClothMeshComponent*> Cloths;
+};
+
+#endif
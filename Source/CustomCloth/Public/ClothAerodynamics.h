@@ -0,0 +1,76 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FClothMeshData;
+class FClothFrameArena;
+
+/**
+ * Coarse grid of wind velocities over the cloth bounds, in component space.
+ * The scene is only queried once per cell every RefreshInterval seconds, triangles look up the nearest cell.
+ */
+struct FClothWindCache
+{
+	/** Time drives the gust phase, pass simulation time for reproducible wind. */
+	void Update(const UWorld* World, const FTransform& ComponentToWorld, const FBox& LocalBox, float Time, float DeltaTime, float VelocityScale);
+
+	FORCEINLINE const FVector3f& Sample(const FVector3f& LocalPosition) const
+	{
+		const FVector3f Cell = (LocalPosition - BoxMin) * InvCellSize;
+		const int32 X = FMath::Clamp(static_cast<int32>(Cell.X), 0, Dimension - 1);
+		const int32 Y = FMath::Clamp(static_cast<int32>(Cell.Y), 0, Dimension - 1);
+		const int32 Z = FMath::Clamp(static_cast<int32>(Cell.Z), 0, Dimension - 1);
+		return Velocities[(Z * Dimension + Y) * Dimension + X];
+	}
+
+	/** Refresh on the next Update, the cached cells are stale once the simulation space moved. */
+	FORCEINLINE void Invalidate() { TimeSinceRefresh = TNumericLimits<float>::Max(); }
+
+	/** Requested cells per axis, applied on the next refresh. */
+	int32 Resolution = 2;
+	float RefreshInterval = 0.1f;
+
+private:
+	/** Cells per axis of Velocities. */
+	int32 Dimension = 1;
+	TArray<FVector3f> Velocities { FVector3f::ZeroVector };
+	FVector3f BoxMin = FVector3f::ZeroVector;
+	FVector3f InvCellSize = FVector3f::ZeroVector;
+	float TimeSinceRefresh = TNumericLimits<float>::Max();
+};
+
+/**
+ * Per-triangle lift and drag. Triangles are gathered into SoA float lanes, evaluated four at a time
+ * and scattered back color by color, no two triangles of one color share a particle.
+ */
+class CUSTOMCLOTH_API FClothAerodynamics
+{
+public:
+	/** Color the triangles of Mesh. Call whenever the topology changes. */
+	void Build(const FClothMeshData& Mesh);
+
+	/** SoA lanes for the pass are carved out of Arena. */
+	void Apply(FClothMeshData& Mesh, float DeltaTime, float AirDensity, FClothFrameArena& Arena);
+
+	FClothWindCache WindCache;
+
+private:
+	void Gather(const FClothMeshData& Mesh);
+	void Evaluate(float AirDensity);
+	void Scatter(FClothMeshData& Mesh, float DeltaTime) const;
+
+	/** Triangles of this color may share particles, it is the last one and never runs in parallel. */
+	static constexpr int32 SerialColor = 64;
+
+	/** Triangle indices sorted by color, ColorOffsets[C]..ColorOffsets[C + 1] is one color. */
+	TArray<uint32> Triangles;
+	TArray<int32> ColorOffsets;
+
+	FORCEINLINE float* Lane(const int32 Index) const { return Scratch + Index * NumLanes; }
+
+	/** Per-frame SoA scratch, NumLanes is the triangle count padded to a multiple of four. Edges in, forces out. */
+	float* Scratch = nullptr;
+	int32 NumLanes = 0;
+};
@@ -0,0 +1,178 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ClothRenderPayload.h"
+#include "Components/PrimitiveComponent.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "ClothBatchRenderer.generated.h"
+
+#pragma region Forward Decl
+class UClothMeshComponent;
+class FClothBatchSceneProxy;
+#pragma endregion Forward Decl
+
+/** First fit range allocator over an unbounded address space, ranges are handed out in elements. */
+class CUSTOMCLOTH_API FClothBatchAllocator
+{
+public:
+	int32 Allocate(int32 Num);
+	void Free(int32 Offset, int32 Num);
+
+	/** End of the highest range in use, the shared buffers need at least this many elements. */
+	FORCEINLINE int32 GetHighWater() const { return HighWater; }
+
+private:
+	struct FRange
+	{
+		int32 Offset;
+		int32 Num;
+	};
+
+	/** Sorted by offset, neighbours are always merged. */
+	TArray<FRange> FreeRanges;
+	int32 HighWater = 0;
+};
+
+/** Where a cloth lives inside the shared buffers of its batch. */
+struct FClothBatchSlot
+{
+	int32 VertexOffset = INDEX_NONE;
+	int32 VertexCapacity = 0;
+	int32 IndexOffset = INDEX_NONE;
+	int32 IndexCount = 0;
+
+	FORCEINLINE bool IsValid() const { return INDEX_NONE != VertexOffset; }
+};
+
+/**
+ * Draws every batched cloth that shares one material and one spatial cell with a single mesh batch per view.
+ * Cloths are packed into shared buffers, positions are moved into the space of this component before upload.
+ */
+UCLASS(Transient, ClassGroup = Rendering)
+class CUSTOMCLOTH_API UClothBatchComponent : public UPrimitiveComponent
+{
+	GENERATED_BODY()
+
+public:
+	UClothBatchComponent(const FObjectInitializer& Initializer);
+
+	void AddCloth(UClothMeshComponent* Cloth);
+	void RemoveCloth(UClothMeshComponent* Cloth);
+
+	/** Stage the current state of a member cloth, it reaches the proxy with the next Flush. */
+	void UpdateCloth(const UClothMeshComponent* Cloth, bool bTopologyChanged);
+
+	/** Upload what the members staged with a single render command and refit to the union of their bounds, once per frame. */
+	void Flush();
+
+	FORCEINLINE int32 GetNumCloths() const { return Slots.Num(); }
+
+	//~ Begin UPrimitiveComponent Interface.
+	virtual FPrimitiveSceneProxy* CreateSceneProxy() override;
+	virtual UMaterialInterface* GetMaterial(int32 ElementIndex) const override;
+	virtual int32 GetNumMaterials() const override;
+	virtual void GetUsedMaterials(TArray<UMaterialInterface*>& OutMaterials, bool bGetDebugMaterials = false) const override;
+	//~ End UPrimitiveComponent Interface.
+
+	UPROPERTY()
+	UMaterialInterface* Material = nullptr;
+
+private:
+	friend class FClothBatchSceneProxy;
+
+	//~ Begin USceneComponent Interface.
+	virtual FBoxSphereBounds CalcBounds(const FTransform& LocalToWorld) const override;
+	//~ End USceneComponent Interface.
+
+	void FreeSlot(FClothBatchSlot& Slot);
+
+	/** Grow the staging copies to the allocator high water. */
+	void ReserveStaging();
+
+	FORCEINLINE void MarkVerticesDirty(const int32 Offset, const int32 Num)
+	{
+		DirtyVertexBegin = FMath::Min(DirtyVertexBegin, Offset);
+		DirtyVertexEnd = FMath::Max(DirtyVertexEnd, Offset + Num);
+	}
+
+	FORCEINLINE void MarkIndicesDirty(const int32 Offset, const int32 Num)
+	{
+		DirtyIndexBegin = FMath::Min(DirtyIndexBegin, Offset);
+		DirtyIndexEnd = FMath::Max(DirtyIndexEnd, Offset + Num);
+	}
+
+	TMap<TWeakObjectPtr<const UClothMeshComponent>, FClothBatchSlot> Slots;
+
+	FClothBatchAllocator VertexAllocator;
+	FClothBatchAllocator IndexAllocator;
+
+	FBox MemberBounds { ForceInit };
+
+	/**
+	 * Game thread copy of the shared buffers. Members write into it as they tick and Flush sends the written span over,
+	 * one render command and one lock per buffer per frame however many cloths the batch holds.
+	 */
+	TArray<FVector3f> StagedPositions;
+	TArray<FColor> StagedColors;
+	TArray<uint32> StagedIndices;
+
+	/** Element spans written since the last flush, empty while Begin >= End. Colors are sent over the vertex span. */
+	int32 DirtyVertexBegin = MAX_int32;
+	int32 DirtyVertexEnd = 0;
+	int32 DirtyIndexBegin = MAX_int32;
+	int32 DirtyIndexEnd = 0;
+	bool bStagedTopologyDirty = false;
+
+	/** Draw ranges the proxy was last flushed with. */
+	int32 FlushedNumVertices = 0;
+	int32 FlushedNumIndices = 0;
+
+	TSharedPtr<FClothRenderPayloadPool, ESPMode::ThreadSafe> PayloadPool;
+};
+
+/** Identifies a batch, cloths are grouped by material and by the world cell they register in. */
+struct FClothBatchKey
+{
+	UMaterialInterface* Material = nullptr;
+	FIntVector Cell = FIntVector::ZeroValue;
+
+	FORCEINLINE bool operator==(const FClothBatchKey& Other) const { return Material == Other.Material && Cell == Other.Cell; }
+
+	friend FORCEINLINE uint32 GetTypeHash(const FClothBatchKey& Key)
+	{
+		return HashCombine(::GetTypeHash(Key.Material), ::GetTypeHash(Key.Cell));
+	}
+};
+
+/**
+ * Owns the UClothBatchComponent of every material and cell for cloths with bBatchRendering.
+ * Cells keep each batch spatially compact, so culling and shadows skip the cloths that are far away
+ * and member positions stay small relative to the batch at the cell center.
+ */
+UCLASS()
+class CUSTOMCLOTH_API UClothBatchSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	UClothBatchComponent* AddCloth(UClothMeshComponent* Cloth);
+
+	/** Edge length of the cells batches are keyed by. A cloth stays in the batch of the cell it registered in. */
+	static constexpr double BatchCellSize = 5000.0;
+
+	//~ Begin UTickableWorldSubsystem Interface.
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickableInEditor() const override;
+	virtual TStatId GetStatId() const override;
+	//~ End UTickableWorldSubsystem Interface.
+
+private:
+	TMap<FClothBatchKey, UClothBatchComponent*> Batches;
+
+	/** Keeps the batches and their materials alive, the keyed map is not visible to the garbage collector. */
+	UPROPERTY()
+	TArray<UClothBatchComponent*> BatchComponents;
+};
@@ -0,0 +1,82 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Bump allocator for scratch data that only lives for one cloth tick.
+ * Requests that do not fit are served from the heap once, the next Reset() grows the block to last frame's
+ * high-water mark so the steady state never touches the allocator.
+ */
+class FClothFrameArena
+{
+public:
+	static constexpr SIZE_T Alignment = 16;
+
+	FClothFrameArena() = default;
+	FClothFrameArena(const FClothFrameArena&) = delete;
+	FClothFrameArena& operator=(const FClothFrameArena&) = delete;
+
+	~FClothFrameArena()
+	{
+		FreeOverflow();
+		FMemory::Free(Block);
+	}
+
+	/** Rewind to the start of the block. Everything handed out since the last Reset() becomes invalid. */
+	void Reset()
+	{
+		if (Overflow.Num() > 0)
+		{
+			FreeOverflow();
+			FMemory::Free(Block);
+			Capacity = Align(Used, Alignment);
+			Block = static_cast<uint8*>(FMemory::Malloc(Capacity, Alignment));
+			++NumGrows;
+		}
+		Used = 0;
+	}
+
+	/** Uninitialized storage for Num elements. */
+	template <typename T>
+	TArrayView<T> Alloc(const int32 Num)
+	{
+		static_assert(TIsTriviallyDestructible<T>::Value, "Arena memory is never destructed.");
+		static_assert(alignof(T) <= Alignment, "Over-aligned types are not supported.");
+
+		const SIZE_T Size = sizeof(T) * Num;
+		const SIZE_T Start = Align(Used, Alignment);
+		Used = Start + Size;
+
+		if (Used <= Capacity)
+		{
+			return TArrayView<T>(reinterpret_cast<T*>(Block + Start), Num);
+		}
+
+		void* Memory = FMemory::Malloc(FMath::Max<SIZE_T>(Size, 1), Alignment);
+		Overflow.Add(Memory);
+		return TArrayView<T>(static_cast<T*>(Memory), Num);
+	}
+
+	/** Number of times the block had to be reallocated, stays constant once the cloth reached steady state. */
+	FORCEINLINE uint32 GetNumGrows() const { return NumGrows; }
+	FORCEINLINE SIZE_T GetCapacity() const { return Capacity; }
+
+private:
+	void FreeOverflow()
+	{
+		for (void* Memory : Overflow)
+		{
+			FMemory::Free(Memory);
+		}
+		Overflow.Reset();
+	}
+
+	uint8* Block = nullptr;
+	SIZE_T Capacity = 0;
+	SIZE_T Used = 0;
+	uint32 NumGrows = 0;
+
+	TArray<void*> Overflow;
+};
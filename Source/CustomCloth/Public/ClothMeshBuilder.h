@@ -0,0 +1,57 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ClothMeshComponent.h"
+
+class UStaticMesh;
+
+/** Spring description produced by the builder, resolved to FClothMassString by the component. */
+struct FClothSpringDesc
+{
+	int32 A;
+	int32 B;
+	float RestLength;
+	ESpringType Type;
+};
+
+struct FClothStaticMeshBuildParams
+{
+	int32 LODIndex = 0;
+	int32 SectionIndex = 0;
+
+	/** Vertices closer than this are welded into one particle (split normals/UV seams). */
+	float WeldThreshold = 0.01f;
+
+	/** Vertices whose color is within PinColorTolerance of PinColor are pinned. */
+	FColor PinColor = FColor::Red;
+	int32 PinColorTolerance = 32;
+};
+
+/**
+ * Builds cloth particles and springs from arbitrary triangle soup.
+ * Everything here runs on the game thread and works on plain arrays, so FClothMassString pointers
+ * can be bound only once the vertex buffer is final.
+ */
+class CUSTOMCLOTH_API FClothMeshBuilder
+{
+public:
+	/** Read one section of a static mesh LOD. Requires CPU access on the mesh in cooked builds. */
+	static bool BuildFromStaticMesh(const UStaticMesh* StaticMesh, const FClothStaticMeshBuildParams& Params, FClothMeshData& OutMesh, TArray<FClothSpringDesc>& OutSprings);
+
+	/** Merge vertices within Threshold of each other and remap the index buffer. Drops degenerate triangles. */
+	static void WeldVertices(FClothMeshData& Mesh, float Threshold);
+
+	/**
+	 * Structural springs along edges, shear springs along quad diagonals (the longest edge of both adjacent triangles)
+	 * and bending springs between the opposite vertices of every other interior edge.
+	 */
+	static void BuildSprings(const FClothMeshData& Mesh, TArray<FClothSpringDesc>& OutSprings);
+
+	/** Renumber particles along a 3D Morton curve so that spatial neighbours are close in memory. */
+	static void ReorderParticlesMorton(FClothMeshData& Mesh);
+
+	/** Reorder triangles for the post-transform vertex cache (Tipsify, Sander et al. 2007). */
+	static void OptimizeIndexBufferForVertexCache(TArray<uint32>& Indices, int32 NumVertices, int32 CacheSize = 16);
+};
@@ -3,16 +3,26 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "ClothAerodynamics.h"
+#include "ClothFrameArena.h"
+#include "ClothRenderPayload.h"
+#include "ClothPinning.h"
+#include "ClothReplication.h"
+#include "ClothTearing.h"
 #include "ClothMeshComponent.generated.h"
 
 #pragma region Forward Decl
 class FPrimitiveSceneProxy;
 class FClothMeshSceneProxy;
+class UStaticMesh;
+class UClothBatchComponent;
 #pragma endregion Forward Decl
 
 // [X]: structural, [Y]: shear, [Z]: bending
 constexpr float Mass = 1.0f;
 constexpr float Cd = 0.5f;
+// Lift coefficient of a flat plate
+constexpr float Cl = 0.3f;
 
 // sqrt(2)
 constexpr float Sqrt2 = 1.414213562;
@@ -30,20 +40,20 @@ struct FClothMeshVertex
 	GENERATED_BODY()
 public:
 
-	/** Vertex position */
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Vertex)
-	FVector Position;
+	/** Vertex position, in simulation space, see UClothMeshComponent::GetSimulationToWorld */
+	UPROPERTY(EditAnywhere, Category = Vertex)
+	FVector3f Position;
 
 	/** Vertex normal */
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Vertex)
-	FVector Normal;
+	UPROPERTY(EditAnywhere, Category = Vertex)
+	FVector3f Normal;
 
 	/** Vertex color */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Vertex)
 	FColor Color;
 
-	UPROPERTY(BlueprintReadOnly, Category = Vertex)
-	FVector Velocity;
+	UPROPERTY(VisibleAnywhere, Category = Vertex)
+	FVector3f Velocity;
 
 	UPROPERTY(BlueprintReadOnly, Category = Vertex)
 	bool bDisablePhys;
@@ -56,7 +66,7 @@ public:
 		, bDisablePhys(false)
 	{}
 
-	explicit FClothMeshVertex(const FVector& InPosition, const FColor& InColor = {255, 255, 255}, const FVector& InNormal = {0.f, 0.f, 1.f})
+	explicit FClothMeshVertex(const FVector3f& InPosition, const FColor& InColor = {255, 255, 255}, const FVector3f& InNormal = {0.f, 0.f, 1.f})
 		: Position(InPosition)
 		, Normal(InNormal)
 		, Color(InColor)
@@ -73,17 +83,17 @@ struct FClothMassString
 	FClothMeshVertex* VertexA;
 	FClothMeshVertex* VertexB;
 
-	FVector GetForce() const
+	FVector3f GetForce() const
 	{
 		check(VertexA);
 		check(VertexB);
 
-		const FVector AToB = VertexB->Position - VertexA->Position;
+		const FVector3f AToB = VertexB->Position - VertexA->Position;
 		const float Distance = AToB.Length();
-		const FVector Dir = AToB.GetSafeNormal();
-		const FVector EForceAToB = Ks * Dir * (Distance - RestLength);
-		const FVector VelAToB = VertexA->Velocity - VertexB->Velocity;
-		const FVector DampAToB = -Kd * Dir * VelAToB.Dot(Dir);
+		const FVector3f Dir = AToB.GetSafeNormal();
+		const FVector3f EForceAToB = Ks * Dir * (Distance - RestLength);
+		const FVector3f VelAToB = VertexA->Velocity - VertexB->Velocity;
+		const FVector3f DampAToB = -Kd * Dir * VelAToB.Dot(Dir);
 		return EForceAToB + DampAToB;
 	}
 
@@ -93,10 +103,10 @@ struct FClothMassString
 		RestLength *= RestLenPercent;
 	}
 
-	void ApplyForce(const float DeltaTime, const FVector AdditionalForce) const
+	void ApplyForce(const float DeltaTime, const FVector3f AdditionalForce) const
 	{
 		// Scale with dt
-		const FVector SpringForce = GetForce() * DeltaTime + AdditionalForce;
+		const FVector3f SpringForce = GetForce() * DeltaTime + AdditionalForce;
 		if (!VertexA->bDisablePhys)
 		{
 			VertexA->Velocity += SpringForce;
@@ -133,15 +143,97 @@ public:
 	}
 };
 
+USTRUCT(BlueprintType)
+struct FClothPinAttachment
+{
+	GENERATED_BODY()
+public:
+
+	/** Bone or socket of the pin target, None pins to the target component itself */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Pin)
+	FName SocketName;
+
+	/** Pinned particle indices, empty takes every particle flagged bDisablePhys */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Pin)
+	TArray<int32> Particles;
+
+	/** 0 is a hard pin, larger values let the particles lag behind the socket */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Pin, meta = (ClampMin = 0))
+	float Compliance = 0.f;
+};
+
+/** Raw bytes of FClothStateCodec, serialized as one blob to stay clear of the replicated array size limit. */
+USTRUCT()
+struct FClothStatePacket
+{
+	GENERATED_BODY()
+public:
+
+	UPROPERTY()
+	uint32 Frame = 0;
+
+	/** Keyframe the data is relative to, equal to Frame for keyframes */
+	UPROPERTY()
+	uint32 BaseFrame = 0;
+
+	UPROPERTY()
+	TArray<uint8> Data;
+
+	bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FClothStatePacket> : TStructOpsTypeTraitsBase2<FClothStatePacket>
+{
+	enum
+	{
+		WithNetSerializer = true,
+	};
+};
+
 UCLASS(meta = (BlueprintSpawnableComponent), ClassGroup = Rendering)
 class CUSTOMCLOTH_API UClothMeshComponent : public UMeshComponent
 {
 	GENERATED_BODY()
 
 public:
+	/**
+	 * Rebuild particles and springs, the scene proxy is resized in place. SetClothResolution and SetClothSize take this
+	 * path, edits in the details panel still re-register the component and with it recreate the proxy.
+	 */
 	void RecreateMesh();
-	void SendMeshDataToRenderThread() const;
+	void SendMeshDataToRenderThread(bool bTopologyChanged = false) const;
+
+	UFUNCTION(BlueprintCallable, Category = "ClothMeshComponent")
+	void SetClothResolution(int32 InDestinyX, int32 InDestinyY);
+
+	UFUNCTION(BlueprintCallable, Category = "ClothMeshComponent")
+	void SetClothSize(FVector2D InClothSize);
+
+	/** Component that PinAttachments follow, defaults to the attach parent. Pins are rebound on the next tick. */
+	UFUNCTION(BlueprintCallable, Category = "ClothMeshComponent")
+	void SetPinTarget(USceneComponent* InPinTarget);
+
+	/** World space position of a particle, the component location for invalid indices. */
+	UFUNCTION(BlueprintCallable, Category = "ClothMeshComponent")
+	FVector GetParticleLocation(int32 ParticleIndex) const;
+
+	/**
+	 * Particles are stored in float relative to SimulationOrigin, which sits in component space.
+	 * Use this at the boundaries (wind, pins, queries) instead of the component transform.
+	 */
+	FORCEINLINE FTransform GetSimulationToWorld() const { return FTransform(SimulationOrigin) * GetComponentTransform(); }
+
+	/** Upper bound of the particle count, including the particles tearing may still add. */
+	FORCEINLINE int32 GetParticleCapacity() const { return FMath::Max(ClothMesh.VertexBuffer.Num(), Tearing.GetVertexCapacity()); }
+
+	/** Heap allocations of the tick path, both stop changing once the cloth reached steady state. */
+	FORCEINLINE int32 GetNumPayloadsAllocated() const { return PayloadPool->GetNumAllocated(); }
+	FORCEINLINE uint32 GetNumFrameArenaGrows() const { return FrameArena.GetNumGrows(); }
+
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+	virtual void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
 	virtual void BeginPlay() override;
 	virtual void InitializeComponent() override;
 
@@ -149,9 +241,40 @@ public:
 
 private:
 	void GeneratePhysicalVertex();
+	bool GeneratePhysicalVertexFromStaticMesh();
 	void RecreateMeshData();
 	void UpdateLocalBounds();
 
+	/** Advance positions by their velocity and return the resulting component space AABB. */
+	FBox IntegratePositions(float DeltaTime);
+	void UpdateDynamicBounds(const FBox& SimulatedBox);
+
+	/** Move SimulationOrigin onto the cloth once it drifted further than RebaseDistance, returns true if it moved. */
+	bool RebaseSimulation(const FBox& SimulatedBox);
+	void SendBoundsToRenderThread();
+
+	/** One solver step, returns true if the topology changed. */
+	bool StepSimulation(float DeltaTime);
+
+	/** Server side bookkeeping per tick, the packets themselves are encoded in PreReplication. */
+	void UpdateReplicationBudget(float DeltaTime, bool bTopologyChanged);
+
+	/** Server of a cloth with bReplicateClothState. */
+	bool IsClothStateAuthority() const;
+
+	/** Client of a cloth with bReplicateClothState, particles follow the server and must keep its topology. */
+	bool IsClothStateProxy() const;
+
+	/** Replicated state carries particles but no topology, so replicated cloths never tear. */
+	FORCEINLINE bool CanTear() const { return bEnableTearing && !bReplicateClothState; }
+
+	UFUNCTION()
+	void OnRep_ClothKeyframe();
+
+	UFUNCTION()
+	void OnRep_ClothDelta();
+	USceneComponent* GetPinTarget() const;
+
 public:
 	//~ Begin UPrimitiveComponent Interface.
 	virtual FPrimitiveSceneProxy* CreateSceneProxy() override;
@@ -159,6 +282,7 @@ public:
 	
 	//~ Begin UActorComponent Interface.
 	virtual void OnRegister() override;
+	virtual void OnUnregister() override;
 	//~ End UActorComponent Interface.
 
 	//~ Begin UMeshComponent Interface.
@@ -196,6 +320,110 @@ public:
 	
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent")
 	float StepTime = 2.0f;
+
+	/** Bounds are padded by this fraction of the cloth extent and only refit once the cloth leaves them. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent", meta = (ClampMin = 0))
+	float BoundsSlack = 0.1f;
+
+	/**
+	 * Draw through the shared batch of all cloths with the same ClothMaterial instead of an own scene proxy.
+	 * Meant for many small cloths, per cloth render settings such as custom depth or lighting channels are not applied.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "ClothMeshComponent|Rendering")
+	bool bBatchRendering = false;
+
+	/**
+	 * The solver runs in float around SimulationOrigin. Once the cloth is this far from it, for example when pinned to a
+	 * target that walked away, the origin is moved onto the cloth so float precision is kept.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent", meta = (ClampMin = 0))
+	float RebaseDistance = 10000.0f;
+
+	/** When set, the cloth is built from this mesh section instead of the DestinyX * DestinyY grid. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Source")
+	UStaticMesh* SourceMesh = nullptr;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Source")
+	int32 SourceLODIndex = 0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Source")
+	int32 SourceSectionIndex = 0;
+
+	/** Vertices of SourceMesh closer than this are welded into one particle. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Source")
+	float WeldThreshold = 0.01f;
+
+	/** Vertices of SourceMesh painted with this color are pinned. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Source")
+	FColor PinVertexColor = FColor::Red;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Source")
+	int32 PinColorTolerance = 32;
+
+	/** Per-triangle lift and drag from wind sources in the scene. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Aerodynamics")
+	bool bEnableAerodynamics = true;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Aerodynamics")
+	float AirDensity = 0.01f;
+
+	/** Wind source speed is scaled by this to get a velocity in cloth units. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Aerodynamics")
+	float WindVelocityScale = 100.0f;
+
+	/** Wind is sampled on a WindCacheResolution^3 grid over the cloth bounds. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Aerodynamics", meta = (ClampMin = 1, ClampMax = 8))
+	int32 WindCacheResolution = 2;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Aerodynamics", meta = (ClampMin = 0))
+	float WindCacheRefreshInterval = 0.1f;
+
+	/**
+	 * Step with FixedTimeStep instead of the frame time, with wind gusts driven by simulation time.
+	 * Every pass is independent of the worker thread count, so equal inputs give bit-identical results with the same
+	 * binary on the same CPU instruction set. Across platforms FMA, reciprocal square root and FMath::Sin may differ.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Determinism")
+	bool bDeterministic = false;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Determinism", meta = (ClampMin = 0.001))
+	float FixedTimeStep = 1.0f / 60.0f;
+
+	/** Steps per tick are capped, time beyond that is dropped rather than spiralling. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Determinism", meta = (ClampMin = 1))
+	int32 MaxSubsteps = 4;
+
+	/** Server sends quantized keyframes and deltas of the particle state to clients. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Replication")
+	bool bReplicateClothState = false;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Replication", meta = (ClampMin = 0))
+	float KeyframeInterval = 1.0f;
+
+	/**
+	 * Sustained budget per cloth, updates are skipped while the budget is used up. Keyframes of large cloths are split
+	 * over several updates and KeyframeInterval counts from their last chunk.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Replication", meta = (ClampMin = 0))
+	int32 ReplicationBytesPerSecond = 8192;
+
+	/** Pins particles to sockets or bones of the pin target, see SetPinTarget. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Pinning")
+	TArray<FClothPinAttachment> PinAttachments;
+
+	/** Break springs stretched beyond TearBreakRatio times their rest length. Not supported together with bReplicateClothState. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Tearing", meta = (EditCondition = "!bReplicateClothState"))
+	bool bEnableTearing = false;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Tearing", meta = (ClampMin = 1))
+	float TearBreakRatio = 2.5f;
+
+	/** Spare particles reserved for tearing, once used up springs still break but the surface is no longer cut. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Tearing", meta = (ClampMin = 0))
+	int32 TearCapacity = 256;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ClothMeshComponent|Tearing", meta = (ClampMin = 1))
+	int32 MaxTearsPerFrame = 8;
 	
 private:
 	UPROPERTY()
@@ -205,4 +433,42 @@ private:
 	FVector2D Padding;
 
 	TArray<FClothMassString> Springs;
+
+	FClothAerodynamics Aerodynamics;
+
+	FClothTearing Tearing;
+
+	FClothPinning Pinning;
+
+	UPROPERTY(Transient)
+	USceneComponent* PinTarget = nullptr;
+
+	UPROPERTY(Transient)
+	UClothBatchComponent* RenderBatch = nullptr;
+
+	/** Component space origin of the particle positions, only changed by RebaseSimulation. */
+	FVector SimulationOrigin = FVector::ZeroVector;
+	FVector LastRebaseShift = FVector::ZeroVector;
+
+	/** Set by rebases and topology changes, the next packet starts a new keyframe. */
+	bool bKeyframeDirty = false;
+
+	float StepAccumulator = 0.f;
+	uint32 SimulationFrame = 0;
+
+	UPROPERTY(ReplicatedUsing = OnRep_ClothKeyframe)
+	FClothStatePacket ClothKeyframe;
+
+	UPROPERTY(ReplicatedUsing = OnRep_ClothDelta)
+	FClothStatePacket ClothDelta;
+
+	FClothStateCodec StateCodec;
+	FClothStatePacket PendingPacket;
+	float ReplicationCredit = 0.f;
+	float TimeSinceKeyframe = 0.f;
+
+	/** Scratch memory for one tick, reset at the start of TickComponent. */
+	FClothFrameArena FrameArena;
+
+	TSharedPtr<FClothRenderPayloadPool, ESPMode::ThreadSafe> PayloadPool;
 };
@@ -0,0 +1,48 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FClothMeshData;
+struct FClothPinAttachment;
+class USceneComponent;
+
+/**
+ * Kinematic pins driven by a parent component. Pinned particles are stored grouped by attachment together with
+ * their offset in socket space, so a frame needs one transform read per attachment and one pass over the list.
+ */
+class CUSTOMCLOTH_API FClothPinning
+{
+public:
+	FORCEINLINE bool IsBound() const { return bBound; }
+	FORCEINLINE void Reset() { bBound = false; }
+
+	/** Remember the particles the built mesh pins, attachments without a particle list take these. */
+	void Build(const FClothMeshData& Mesh);
+
+	/** Capture socket space offsets from the current pose. Attachments without particles take the ones found by Build. */
+	void Bind(FClothMeshData& Mesh, const TArray<FClothPinAttachment>& Attachments, const USceneComponent* Target, const FTransform& ClothToWorld);
+
+	/** Move pinned particles to where their sockets are this frame. */
+	void Apply(FClothMeshData& Mesh, const USceneComponent* Target, const FTransform& ClothToWorld, float DeltaTime);
+
+private:
+	struct FBinding
+	{
+		int32 BoneIndex = INDEX_NONE;
+		FName SocketName;
+		FTransform SocketToBone;
+		float Compliance = 0.f;
+		int32 First = 0;
+		int32 Num = 0;
+	};
+
+	FTransform GetSocketToCloth(const FBinding& Binding, const USceneComponent* Target, const FTransform& ClothToWorld, const TArray<FTransform>* BoneTransforms) const;
+
+	TArray<FBinding> Bindings;
+	TArray<int32> Particles;
+	TArray<FVector3f> Offsets;
+	TArray<int32> DefaultPinned;
+	bool bBound = false;
+};
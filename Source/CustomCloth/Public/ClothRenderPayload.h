@@ -0,0 +1,43 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/LockFreeList.h"
+
+struct FClothMeshData;
+
+/** Per-frame vertex data handed from the game thread to FClothMeshSceneProxy. */
+struct FClothMeshRenderPayload
+{
+	TArray<FVector3f> Positions;
+
+	/** Only filled when bTopologyDirty is set. */
+	TArray<FColor> Colors;
+	TArray<uint32> Indices;
+	bool bTopologyDirty = false;
+
+	/** Reuses the existing allocations as long as the counts do not grow. Offset is added to every position. */
+	void CopyFrom(const FClothMeshData& ClothMesh, bool bWithTopology, const FVector3f& Offset = FVector3f::ZeroVector);
+};
+
+/**
+ * Recycles render payloads. The game thread acquires one per tick, the render thread pushes it back once uploaded.
+ * Owned through a thread-safe shared pointer so payloads still in flight can be returned after the component is gone.
+ */
+class CUSTOMCLOTH_API FClothRenderPayloadPool
+{
+public:
+	FClothRenderPayloadPool() = default;
+	~FClothRenderPayloadPool();
+
+	FClothMeshRenderPayload* Acquire();
+	void Release(FClothMeshRenderPayload* Payload);
+
+	/** Payloads ever created, bounded by the number of frames the render thread lags behind. */
+	FORCEINLINE int32 GetNumAllocated() const { return NumAllocated.load(std::memory_order_relaxed); }
+
+private:
+	TLockFreePointerListUnordered<FClothMeshRenderPayload, PLATFORM_CACHE_LINE_SIZE> FreePayloads;
+	std::atomic<int32> NumAllocated { 0 };
+};
@@ -0,0 +1,78 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FClothMeshData;
+struct FClothMeshVertex;
+struct FClothStatePacket;
+
+/**
+ * Quantized particle state for replication.
+ * A keyframe stores positions as 16 bit fractions of the cloth bounds and velocities as 16 bit fractions of the
+ * fastest particle. Deltas store the zig-zag varint difference of every quantized value against the last keyframe,
+ * so a cloth that barely moved costs about one byte per component.
+ * Both are cut into chunks of whole particles so large cloths stay below the packet size asked for. Keyframe chunks go
+ * out back to back and only take effect once the last one arrived, delta chunks walk over the particles round robin.
+ */
+class CUSTOMCLOTH_API FClothStateCodec
+{
+public:
+	/** Server. Becomes the base for following deltas once EncodeKeyframeChunk sent all of it. Bounds are in simulation space, Origin places it in the component. */
+	void BeginKeyframe(const FClothMeshData& Mesh, const FBox& Bounds, const FVector& Origin, uint32 Frame);
+
+	/** Server. Next chunk of the current keyframe with at most MaxBytes of particle data, at least one particle. */
+	void EncodeKeyframeChunk(int32 MaxBytes, FClothStatePacket& Out);
+
+	/** Server. Returns false when the state no longer fits the keyframe range and a new keyframe is needed. */
+	bool EncodeDelta(const FClothMeshData& Mesh, uint32 Frame, int32 MaxBytes, FClothStatePacket& Out);
+
+	/** Client. Returns true once the last chunk of a keyframe arrived and was applied, a lost chunk drops the whole keyframe. */
+	bool DecodeKeyframe(const FClothStatePacket& Packet, FClothMeshData& Mesh);
+
+	/** Client. Packets for a different particle count are ignored, topology is not replicated. */
+	bool DecodeDelta(const FClothStatePacket& Packet, FClothMeshData& Mesh) const;
+
+	FORCEINLINE bool HasKeyframe() const { return bHasKeyframe; }
+	FORCEINLINE uint32 GetKeyframe() const { return KeyframeFrame; }
+
+	/** Server. Chunks of the current keyframe are still outstanding, no deltas until they went out. */
+	FORCEINLINE bool IsSendingKeyframe() const { return bSendingKeyframe; }
+
+	/** Simulation origin of the current keyframe, deltas share it. */
+	FORCEINLINE const FVector& GetOrigin() const { return Space.Origin; }
+
+private:
+	static constexpr int32 ComponentsPerParticle = 6;
+
+	/** Where the quantized values of one keyframe live. */
+	struct FQuantizationSpace
+	{
+		FVector Origin = FVector::ZeroVector;
+		FVector3f BoxMin = FVector3f::ZeroVector;
+		FVector3f BoxSize = FVector3f::OneVector;
+		float VelocityRange = 1.f;
+	};
+
+	/** Returns false if any component had to be clamped into the keyframe range. */
+	bool Quantize(const FClothMeshVertex& Vertex, uint16* Out) const;
+	void Dequantize(const uint16* In, FClothMeshVertex& Vertex) const;
+
+	FQuantizationSpace Space;
+
+	/** Quantized position xyz followed by velocity xyz per particle. */
+	TArray<uint16> Keyframe;
+	uint32 KeyframeFrame = 0;
+	bool bHasKeyframe = false;
+
+	/** Server. First particle of the next keyframe or delta chunk. */
+	int32 SendCursor = 0;
+	bool bSendingKeyframe = false;
+
+	/** Client. Keyframe being assembled, IncomingCursor is the next particle expected or INDEX_NONE. */
+	FQuantizationSpace IncomingSpace;
+	TArray<uint16> IncomingKeyframe;
+	uint32 IncomingFrame = 0;
+	int32 IncomingCursor = INDEX_NONE;
+};
@@ -0,0 +1,55 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FClothMassString;
+struct FClothMeshData;
+struct FClothMeshVertex;
+
+/**
+ * Fixed stride vertex -> element lists. A split vertex only ever takes over part of the lists of the vertex it was
+ * split from, so the stride measured at build time holds for every particle created by tearing.
+ */
+struct FClothVertexAdjacency
+{
+	void Init(int32 NumVertices, int32 VertexCapacity, int32 InStride);
+
+	FORCEINLINE TArrayView<int32> Get(const int32 Vertex) { return TArrayView<int32>(Slots.GetData() + Vertex * Stride, Counts[Vertex]); }
+
+	void Add(int32 Vertex, int32 Element);
+	void Remove(int32 Vertex, int32 Element);
+	void Replace(int32 Vertex, int32 OldElement, int32 NewElement);
+
+private:
+	TArray<int32> Slots;
+	TArray<int32> Counts;
+	int32 Stride = 0;
+};
+
+/**
+ * Strain based tearing. Springs stretched beyond their break ratio are removed in O(1) and the stressed particle is
+ * duplicated, only the triangles and springs around it are rewritten. The vertex buffer keeps spare capacity so that
+ * tearing never reallocates it, which would invalidate the vertex pointers held by FClothMassString.
+ */
+class CUSTOMCLOTH_API FClothTearing
+{
+public:
+	/** Reserve TearCapacity spare particles, rebinding Springs if the vertex buffer moves, and build adjacency. */
+	void Build(FClothMeshData& Mesh, TArray<FClothMassString>& Springs, int32 TearCapacity);
+
+	/** Break over-stretched springs, returns the number of tears so the caller can push the new topology. */
+	int32 Step(FClothMeshData& Mesh, TArray<FClothMassString>& Springs, float BreakRatio, int32 MaxTears);
+
+	/** Particles the adjacency has room for. The vertex buffer may have reserved more, this is the limit. */
+	FORCEINLINE int32 GetVertexCapacity() const { return VertexCapacity; }
+
+private:
+	void RemoveSpring(TArray<FClothMassString>& Springs, int32 SpringIndex, const FClothMeshVertex* Base);
+	void SplitVertex(FClothMeshData& Mesh, TArray<FClothMassString>& Springs, int32 Vertex, int32 Other);
+
+	FClothVertexAdjacency VertexTriangles;
+	FClothVertexAdjacency VertexSprings;
+	int32 VertexCapacity = 0;
+};